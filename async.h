@@ -0,0 +1,128 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <string>
+#include <utility>
+
+template <class T>
+struct TaskResult {
+    T value{};
+
+    void return_value(T v) {
+        value = std::move(v);
+    }
+
+    T Take() {
+        return std::move(value);
+    }
+};
+
+template <>
+struct TaskResult<void> {
+    void return_void() {
+    }
+
+    void Take() {
+    }
+};
+
+// Lazily started coroutine. Awaiting a task runs it and resumes the awaiter through symmetric
+// transfer when it finishes, so a chain of nested evaluations never grows the native stack.
+template <class T = void>
+class Task {
+public:
+    struct promise_type : TaskResult<T> {
+        std::coroutine_handle<> continuation = std::noop_coroutine();
+        std::exception_ptr error;
+
+        Task get_return_object() {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        auto final_suspend() noexcept {
+            struct FinalAwaiter {
+                bool await_ready() noexcept {
+                    return false;
+                }
+
+                std::coroutine_handle<> await_suspend(
+                    std::coroutine_handle<promise_type> handle) noexcept {
+                    return handle.promise().continuation;
+                }
+
+                void await_resume() noexcept {
+                }
+            };
+            return FinalAwaiter{};
+        }
+
+        void unhandled_exception() {
+            error = std::current_exception();
+        }
+    };
+
+    Task() = default;
+
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        handle_.promise().continuation = caller;
+        return handle_;
+    }
+
+    T await_resume() {
+        if (handle_.promise().error) {
+            std::rethrow_exception(handle_.promise().error);
+        }
+        return handle_.promise().Take();
+    }
+
+    std::coroutine_handle<promise_type> GetHandle() const {
+        return handle_;
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+enum class AsyncStatus { kReady, kWaiting, kDone };
+
+struct AsyncState {
+    AsyncStatus status = AsyncStatus::kReady;
+    std::coroutine_handle<> resume_point;
+    std::function<void()> on_ready;
+    bool starting = false;
+    std::string result;
+    std::exception_ptr error;
+    std::string output;
+};
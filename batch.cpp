@@ -0,0 +1,273 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const Builtin* FindBuiltin(const Symbol& symbol, const FunctionTable& funcs) {
+    int32_t slot = symbol.GetSlot();
+    if (slot < 0) {
+        slot = FindFunctionSlot(symbol.GetName());
+    }
+    if (slot < 0 || static_cast<size_t>(slot) >= funcs.size() || !funcs[slot].func) {
+        return nullptr;
+    }
+    return &funcs[slot];
+}
+
+std::unique_ptr<BatchProgram> BatchProgram::Compile(const std::shared_ptr<Object>& expression,
+                                                    const FunctionTable& funcs,
+                                                    const ColumnMap& columns) {
+    std::unique_ptr<BatchProgram> res(new BatchProgram());
+    if (!res->CompileNode(expression, funcs, columns, &res->is_bool_, 1)) {
+        return nullptr;
+    }
+    res->buffers_.resize(res->max_depth_ * kBatchSize);
+    res->acc_.resize(kBatchSize);
+    return res;
+}
+
+bool BatchProgram::CompileNode(const std::shared_ptr<Object>& node, const FunctionTable& funcs,
+                               const ColumnMap& columns, bool* is_bool, size_t depth) {
+    max_depth_ = std::max(max_depth_, depth);
+    if (Is<Number>(node)) {
+        code_.push_back({BuiltinKind::kGeneric, 0, As<Number>(node)->GetValue(), nullptr});
+        *is_bool = false;
+        return true;
+    }
+    if (Is<Bool>(node)) {
+        code_.push_back({BuiltinKind::kGeneric, 0, As<Bool>(node)->GetBool(), nullptr});
+        *is_bool = true;
+        return true;
+    }
+    if (Is<Symbol>(node)) {
+        auto it = columns.find(As<Symbol>(node)->GetName());
+        if (it == columns.end()) {
+            return false;
+        }
+        code_.push_back({BuiltinKind::kGeneric, 0, 0, it->second.data()});
+        *is_bool = false;
+        return true;
+    }
+    if (!Is<Cell>(node) || !Is<Symbol>(As<Cell>(node)->GetFirst())) {
+        return false;
+    }
+    auto builtin = FindBuiltin(*As<Symbol>(As<Cell>(node)->GetFirst()), funcs);
+    if (!builtin || builtin->kind == BuiltinKind::kGeneric ||
+        builtin->kind == BuiltinKind::kQuote || builtin->kind > BuiltinKind::kNot) {
+        return false;
+    }
+    auto kind = builtin->kind;
+    bool logic = kind == BuiltinKind::kAnd || kind == BuiltinKind::kOr || kind == BuiltinKind::kNot;
+    uint32_t argc = 0;
+    auto args = As<Cell>(node)->GetSecond();
+    while (args) {
+        if (!Is<Cell>(args)) {
+            return false;
+        }
+        auto cell = As<Cell>(args);
+        bool arg_bool;
+        if (!CompileNode(cell->GetFirst(), funcs, columns, &arg_bool, depth + argc) ||
+            arg_bool != logic) {
+            return false;
+        }
+        ++argc;
+        args = cell->GetSecond();
+    }
+    if ((kind == BuiltinKind::kAbs || kind == BuiltinKind::kNot) && argc != 1) {
+        return false;
+    }
+    if (argc == 0 && kind >= BuiltinKind::kSubstract && kind <= BuiltinKind::kMin &&
+        kind != BuiltinKind::kMultiply) {
+        return false;
+    }
+    code_.push_back({kind, argc, 0, nullptr});
+    *is_bool = logic || (kind >= BuiltinKind::kEq && kind <= BuiltinKind::kGreaterEq);
+    return true;
+}
+
+template <class Op>
+static void Chain(int64_t* args, uint32_t argc, size_t rows, int64_t* acc, Op op) {
+    std::fill(acc, acc + rows, 1);
+    for (uint32_t i = 1; i < argc; ++i) {
+        const int64_t* lhs = args + (i - 1) * kBatchSize;
+        const int64_t* rhs = args + i * kBatchSize;
+        for (size_t r = 0; r < rows; ++r) {
+            acc[r] &= op(lhs[r], rhs[r]);
+        }
+    }
+    std::memcpy(args, acc, rows * sizeof(int64_t));
+}
+
+bool BatchProgram::Apply(const Instruction& instr, int64_t* args, size_t rows) {
+    int64_t* res = args;
+    uint32_t argc = instr.argc;
+    auto arg = [args](uint32_t i) { return args + i * kBatchSize; };
+    int64_t overflow = 0;
+    switch (instr.kind) {
+        case BuiltinKind::kAdd:
+        case BuiltinKind::kAnd:
+        case BuiltinKind::kOr:
+        case BuiltinKind::kMultiply:
+            if (argc == 0) {
+                int64_t value = instr.kind == BuiltinKind::kOr ? 0 : instr.kind != BuiltinKind::kAdd;
+                std::fill(res, res + rows, value);
+                return true;
+            }
+            break;
+        default:
+            break;
+    }
+    switch (instr.kind) {
+        case BuiltinKind::kAdd:
+            for (uint32_t i = 1; i < argc; ++i) {
+                const int64_t* rhs = arg(i);
+                for (size_t r = 0; r < rows; ++r) {
+                    int64_t sum = static_cast<int64_t>(static_cast<uint64_t>(res[r]) + rhs[r]);
+                    overflow |= (res[r] ^ sum) & (rhs[r] ^ sum);
+                    res[r] = sum;
+                }
+            }
+            return overflow >= 0;
+        case BuiltinKind::kSubstract:
+            for (uint32_t i = 1; i < argc; ++i) {
+                const int64_t* rhs = arg(i);
+                for (size_t r = 0; r < rows; ++r) {
+                    int64_t diff = static_cast<int64_t>(static_cast<uint64_t>(res[r]) - rhs[r]);
+                    overflow |= (res[r] ^ rhs[r]) & (res[r] ^ diff);
+                    res[r] = diff;
+                }
+            }
+            return overflow >= 0;
+        case BuiltinKind::kMultiply:
+            for (uint32_t i = 1; i < argc; ++i) {
+                const int64_t* rhs = arg(i);
+                for (size_t r = 0; r < rows; ++r) {
+                    overflow |= __builtin_mul_overflow(res[r], rhs[r], &res[r]);
+                }
+            }
+            return !overflow;
+        case BuiltinKind::kDivide:
+            for (uint32_t i = 1; i < argc; ++i) {
+                const int64_t* rhs = arg(i);
+                for (size_t r = 0; r < rows; ++r) {
+                    if (rhs[r] == 0 || (res[r] == INT64_MIN && rhs[r] == -1)) {
+                        return false;
+                    }
+                    res[r] /= rhs[r];
+                }
+            }
+            return true;
+        case BuiltinKind::kMax:
+            for (uint32_t i = 1; i < argc; ++i) {
+                const int64_t* rhs = arg(i);
+                for (size_t r = 0; r < rows; ++r) {
+                    res[r] = std::max(res[r], rhs[r]);
+                }
+            }
+            return true;
+        case BuiltinKind::kMin:
+            for (uint32_t i = 1; i < argc; ++i) {
+                const int64_t* rhs = arg(i);
+                for (size_t r = 0; r < rows; ++r) {
+                    res[r] = std::min(res[r], rhs[r]);
+                }
+            }
+            return true;
+        case BuiltinKind::kAbs:
+            for (size_t r = 0; r < rows; ++r) {
+                overflow |= res[r] == INT64_MIN;
+                res[r] = res[r] < 0 ? -res[r] : res[r];
+            }
+            return !overflow;
+        case BuiltinKind::kAnd:
+            for (uint32_t i = 1; i < argc; ++i) {
+                const int64_t* rhs = arg(i);
+                for (size_t r = 0; r < rows; ++r) {
+                    res[r] &= rhs[r];
+                }
+            }
+            return true;
+        case BuiltinKind::kOr:
+            for (uint32_t i = 1; i < argc; ++i) {
+                const int64_t* rhs = arg(i);
+                for (size_t r = 0; r < rows; ++r) {
+                    res[r] |= rhs[r];
+                }
+            }
+            return true;
+        case BuiltinKind::kNot:
+            for (size_t r = 0; r < rows; ++r) {
+                res[r] ^= 1;
+            }
+            return true;
+        case BuiltinKind::kEq:
+            Chain(args, argc, rows, acc_.data(), [](int64_t a, int64_t b) { return a == b; });
+            return true;
+        case BuiltinKind::kLess:
+            Chain(args, argc, rows, acc_.data(), [](int64_t a, int64_t b) { return a < b; });
+            return true;
+        case BuiltinKind::kLessEq:
+            Chain(args, argc, rows, acc_.data(), [](int64_t a, int64_t b) { return a <= b; });
+            return true;
+        case BuiltinKind::kGreater:
+            Chain(args, argc, rows, acc_.data(), [](int64_t a, int64_t b) { return a > b; });
+            return true;
+        case BuiltinKind::kGreaterEq:
+            Chain(args, argc, rows, acc_.data(), [](int64_t a, int64_t b) { return a >= b; });
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool BatchProgram::Evaluate(size_t from, size_t rows, int64_t* res) {
+    size_t top = 0;
+    for (auto& instr : code_) {
+        if (instr.kind == BuiltinKind::kGeneric) {
+            int64_t* dst = buffers_.data() + top * kBatchSize;
+            if (instr.column) {
+                std::memcpy(dst, instr.column + from, rows * sizeof(int64_t));
+            } else {
+                std::fill(dst, dst + rows, instr.value);
+            }
+            ++top;
+            continue;
+        }
+        // A call replaces its arguments with its result, so it always leaves one more value on
+        // the stack than before its arguments were pushed.
+        top -= instr.argc;
+        if (!Apply(instr, buffers_.data() + top * kBatchSize, rows)) {
+            return false;
+        }
+        ++top;
+    }
+    std::memcpy(res, buffers_.data(), rows * sizeof(int64_t));
+    return true;
+}
+
+std::shared_ptr<Object> BindRow(const std::shared_ptr<Object>& expression,
+                                const ColumnMap& columns, size_t row) {
+    if (Is<Symbol>(expression)) {
+        auto it = columns.find(As<Symbol>(expression)->GetName());
+        if (it != columns.end()) {
+            return std::make_shared<Number>(it->second[row]);
+        }
+        return expression;
+    }
+    if (!Is<Cell>(expression)) {
+        return expression;
+    }
+    auto cell = As<Cell>(expression);
+    auto first = Is<Symbol>(cell->GetFirst()) ? cell->GetFirst() : BindRow(cell->GetFirst(), columns, row);
+    std::vector<std::shared_ptr<Object>> items{first};
+    auto rest = cell->GetSecond();
+    while (Is<Cell>(rest)) {
+        items.push_back(BindRow(As<Cell>(rest)->GetFirst(), columns, row));
+        rest = As<Cell>(rest)->GetSecond();
+    }
+    auto res = std::make_shared<Cell>(items.back(), BindRow(rest, columns, row));
+    for (size_t i = items.size() - 1; i > 0; --i) {
+        res = std::make_shared<Cell>(items[i - 1], std::move(res));
+    }
+    return res;
+}
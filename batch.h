@@ -0,0 +1,56 @@
+#pragma once
+
+#include "functions.h"
+#include "object.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+constexpr size_t kBatchSize = 1024;
+
+using ColumnMap = std::map<std::string, std::span<const int64_t>>;
+
+struct BatchResult {
+    bool is_predicate = false;
+    std::vector<int64_t> values;
+    std::vector<uint64_t> selection;
+};
+
+class BatchProgram {
+public:
+    static std::unique_ptr<BatchProgram> Compile(const std::shared_ptr<Object>& expression,
+                                                 const FunctionTable& funcs,
+                                                 const ColumnMap& columns);
+
+    bool IsPredicate() const {
+        return is_bool_;
+    }
+
+    bool Evaluate(size_t from, size_t rows, int64_t* res);
+
+private:
+    struct Instruction {
+        BuiltinKind kind;
+        uint32_t argc;
+        int64_t value;
+        const int64_t* column;
+    };
+
+    bool CompileNode(const std::shared_ptr<Object>& node, const FunctionTable& funcs,
+                     const ColumnMap& columns, bool* is_bool, size_t depth);
+
+    bool Apply(const Instruction& instr, int64_t* args, size_t rows);
+
+    std::vector<Instruction> code_;
+    std::vector<int64_t> buffers_;
+    std::vector<int64_t> acc_;
+    size_t max_depth_ = 0;
+    bool is_bool_ = false;
+};
+
+std::shared_ptr<Object> BindRow(const std::shared_ptr<Object>& expression,
+                                const ColumnMap& columns, size_t row);
@@ -0,0 +1,378 @@
+// Microbenchmarks for the interpreter's data layout, image format and builtin paths. Every
+// command prints one JSON object per measured case on stdout.
+//
+//   bench cells      heap footprint and traversal time of parsed lists against vectors
+//   bench image [--mb N] [--dir DIR]
+//                    cold start from an N MB rule set as text against the same forms as an image
+//   bench vectors    vector-ref against list-ref at 1k, 100k and 10M elements
+//   bench bulk       native map and fold-left against the unrolled expressions users wrote before
+//   bench calls      binary arithmetic through the builtin fast paths against generic builtins
+//
+// Times are the mean over as many repetitions as fit in a fraction of a second, best of three
+// rounds. The image command writes its two files to DIR, /tmp by default, and removes them.
+
+#include "error.h"
+#include "image.h"
+#include "loader.h"
+#include "parser.h"
+#include "scheme.h"
+#include "tokenizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <malloc.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr double kRoundSeconds = 0.2;
+constexpr int kRounds = 3;
+
+[[noreturn]] void Usage() {
+    std::cerr << "usage: bench cells\n"
+                 "       bench image [--mb N] [--dir DIR]\n"
+                 "       bench vectors\n"
+                 "       bench bulk\n"
+                 "       bench calls\n";
+    std::exit(2);
+}
+
+double Seconds(Clock::time_point begin) {
+    return std::chrono::duration<double>(Clock::now() - begin).count();
+}
+
+// Mean nanoseconds per call of body, best of kRounds rounds of at least kRoundSeconds each.
+template <class F>
+double NsPerCall(F&& body) {
+    double best = 0;
+    for (int round = 0; round < kRounds; ++round) {
+        size_t calls = 0;
+        auto begin = Clock::now();
+        double elapsed = 0;
+        for (size_t batch = 1; elapsed < kRoundSeconds; batch *= 2) {
+            for (size_t i = 0; i < batch; ++i) {
+                body();
+            }
+            calls += batch;
+            elapsed = Seconds(begin);
+        }
+        double ns = elapsed * 1e9 / calls;
+        best = round ? std::min(best, ns) : ns;
+    }
+    return best;
+}
+
+// Bytes the allocator hands out, headers included, so a structure's footprint counts its
+// shared_ptr control blocks and malloc overhead as well as the objects themselves.
+size_t HeapInUse() {
+    auto info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+std::shared_ptr<Object> Parse(const std::string& text) {
+    std::stringstream in{text};
+    Tokenizer tokenizer{&in};
+    return Read(&tokenizer);
+}
+
+std::string Numbers(size_t count, const char* open) {
+    std::string res = open;
+    for (size_t i = 0; i < count; ++i) {
+        res += std::to_string(i) + " ";
+    }
+    res.back() = ')';
+    return res;
+}
+
+// A builtin returning one prebuilt object, so expressions can reach data of any size without
+// parsing it on every run.
+class ConstantFunction : public IObjectFunction {
+public:
+    explicit ConstantFunction(std::shared_ptr<Object> value) : value_(std::move(value)) {
+    }
+
+    std::shared_ptr<Object> InvokeValue(ArgSpan) override {
+        return value_;
+    }
+
+private:
+    std::shared_ptr<Object> value_;
+};
+
+int Cells() {
+    for (size_t count : {1000, 100000, 1000000}) {
+        size_t before = HeapInUse();
+        auto list = Parse(Numbers(count, "("));
+        size_t list_bytes = HeapInUse() - before;
+        before = HeapInUse();
+        auto vector = Parse(Numbers(count, "#("));
+        size_t vector_bytes = HeapInUse() - before;
+
+        int64_t sum = 0;
+        double list_ns = NsPerCall([&list, &sum] {
+            for (auto cell = static_cast<const Cell*>(list.get()); cell;
+                 cell = static_cast<const Cell*>(cell->GetSecond().get())) {
+                sum += static_cast<const Number*>(cell->GetFirst().get())->GetValue();
+            }
+        });
+        double vector_ns = NsPerCall([&vector, &sum] {
+            for (auto& item : As<Vector>(vector)->GetItems()) {
+                sum += static_cast<const Number*>(item.get())->GetValue();
+            }
+        });
+        if (sum < 0) {
+            return 1;
+        }
+        std::cout << "{\"bench\":\"cells\",\"elements\":" << count
+                  << ",\"bytes_per_element\":{\"list\":" << double(list_bytes) / count
+                  << ",\"vector\":" << double(vector_bytes) / count
+                  << "},\"traversal_ns_per_element\":{\"list\":" << list_ns / count
+                  << ",\"vector\":" << vector_ns / count << "}}\n";
+    }
+    return 0;
+}
+
+// Rule-shaped top-level forms with varied symbols, numbers and strings, to about mb megabytes.
+std::string RuleSet(size_t mb) {
+    std::mt19937_64 random{1};
+    std::string res;
+    for (size_t i = 0; res.size() < mb << 20; ++i) {
+        auto id = std::to_string(i);
+        auto n = std::to_string(random() % 100000);
+        auto field = std::to_string(random() % 64);
+        res += "(define-rule rule-" + id + " (when (and (> (hash-ref row \"price-" + field +
+               "\") " + n + ") (< (vector-ref weights " + field + ") " + n +
+               ".5)) (or (member? tag-" + field + " '(a b c)) (not (null? row)))) (emit 'alert " +
+               "\"rule " + id + " fired\" (list " + n + " " + field + " #t)))\n";
+    }
+    return res;
+}
+
+int Image(size_t mb, const std::string& dir) {
+    auto text_path = dir + "/bench_rules.scm";
+    auto image_path = dir + "/bench_rules.img";
+    try {
+        auto text = RuleSet(mb);
+        std::ofstream(text_path) << text;
+
+        double construct_ns = NsPerCall([] { Interpreter interpreter; });
+
+        auto begin = Clock::now();
+        auto forms = LoadForms(text_path, 1);
+        double text_seconds = Seconds(begin);
+        size_t count = forms.size();
+
+        auto image = WriteImage(forms);
+        forms.clear();
+        std::ofstream(image_path, std::ios::binary) << image;
+
+        begin = Clock::now();
+        forms = LoadImage(image_path);
+        double image_seconds = Seconds(begin);
+        if (forms.size() != count) {
+            throw RuntimeError();
+        }
+
+        std::cout << "{\"bench\":\"image\",\"forms\":" << count
+                  << ",\"file_bytes\":{\"text\":" << text.size() << ",\"image\":" << image.size()
+                  << "},\"interpreter_construct_ns\":" << construct_ns
+                  << ",\"load_seconds\":{\"text\":" << text_seconds
+                  << ",\"image\":" << image_seconds << "}}\n";
+    } catch (const std::exception& e) {
+        std::cerr << "bench: " << e.what() << "\n";
+        std::remove(text_path.c_str());
+        std::remove(image_path.c_str());
+        return 1;
+    }
+    std::remove(text_path.c_str());
+    std::remove(image_path.c_str());
+    return 0;
+}
+
+// Parsed calls of name on (data) and a random index below count, to cycle through.
+std::vector<std::shared_ptr<Object>> IndexCalls(const std::string& name, size_t count) {
+    std::mt19937_64 random{1};
+    std::vector<std::shared_ptr<Object>> res;
+    for (int i = 0; i < 1024; ++i) {
+        res.push_back(Parse("(" + name + " (data) " + std::to_string(random() % count) + ")"));
+    }
+    return res;
+}
+
+double NsPerRun(Interpreter* interpreter, const std::vector<std::shared_ptr<Object>>& calls) {
+    size_t next = 0;
+    std::string out;
+    return NsPerCall([&] {
+        out.clear();
+        interpreter->Run(calls[next++ % calls.size()], &out);
+    });
+}
+
+int Vectors() {
+    for (size_t count : {1000, 100000, 10000000}) {
+        std::vector<std::shared_ptr<Object>> items;
+        items.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            items.push_back(std::make_shared<Number>(i));
+        }
+        std::shared_ptr<Object> list;
+        for (size_t i = count; i > 0; --i) {
+            list = std::make_shared<Cell>(items[i - 1], std::move(list));
+        }
+        auto vector = std::make_shared<Vector>(std::move(items));
+
+        Interpreter interpreter;
+        interpreter.SetMemoThreshold(0);
+        interpreter.Register("data", std::make_shared<ConstantFunction>(list));
+        double list_ns = NsPerRun(&interpreter, IndexCalls("list-ref", count));
+        interpreter.Register("data", std::make_shared<ConstantFunction>(vector));
+        double vector_ns = NsPerRun(&interpreter, IndexCalls("vector-ref", count));
+
+        std::cout << "{\"bench\":\"vectors\",\"elements\":" << count
+                  << ",\"ns_per_ref\":{\"list-ref\":" << list_ns
+                  << ",\"vector-ref\":" << vector_ns << "}}\n";
+    }
+    return 0;
+}
+
+// Times Run on the text, parse included: unrolled expressions cost as much to read as to run.
+double NsPerText(Interpreter* interpreter, const std::string& expression) {
+    std::string out;
+    return NsPerCall([&] {
+        out.clear();
+        interpreter->Run(expression, &out);
+    });
+}
+
+int Bulk() {
+    Interpreter interpreter;
+    interpreter.SetMemoThreshold(0);
+    for (size_t count : {100, 1000, 10000}) {
+        std::string data = "'(";
+        std::string unrolled_map = "(list";
+        std::string unrolled_fold = "(+ 0";
+        for (size_t i = 0; i < count; ++i) {
+            auto n = std::to_string(i % 2 ? -int64_t(i) : int64_t(i));
+            data += n + " ";
+            unrolled_map += " (abs " + n + ")";
+            unrolled_fold += " " + n;
+        }
+        data.back() = ')';
+        unrolled_map += ")";
+        unrolled_fold += ")";
+        std::string map = "(map abs " + data + ")";
+        std::string fold = "(fold-left + 0 " + data + ")";
+        if (interpreter.Run(map) != interpreter.Run(unrolled_map) ||
+            interpreter.Run(fold) != interpreter.Run(unrolled_fold)) {
+            std::cerr << "bench: native and unrolled results differ\n";
+            return 1;
+        }
+
+        std::cout << "{\"bench\":\"bulk\",\"elements\":" << count
+                  << ",\"map_ns\":{\"native\":" << NsPerText(&interpreter, map)
+                  << ",\"unrolled\":" << NsPerText(&interpreter, unrolled_map)
+                  << "},\"fold_ns\":{\"native\":" << NsPerText(&interpreter, fold)
+                  << ",\"unrolled\":" << NsPerText(&interpreter, unrolled_fold)
+                  << "},\"text_bytes\":{\"native\":" << map.size()
+                  << ",\"unrolled\":" << unrolled_map.size() << "}}\n";
+    }
+    return 0;
+}
+
+// A full binary tree of depth levels over small operands. Products sit only at the bottom so
+// no result overflows.
+std::string BinaryTree(std::mt19937_64* random, int depth, const char* const* names) {
+    if (depth == 1) {
+        return "(" + std::string(names[0]) + " " + std::to_string((*random)() % 10) + " " +
+               std::to_string((*random)() % 10) + ")";
+    }
+    return "(" + std::string(names[1 + (*random)() % 4]) + " " +
+           BinaryTree(random, depth - 1, names) + " " + BinaryTree(random, depth - 1, names) + ")";
+}
+
+int Calls() {
+    constexpr int kDepth = 6;
+    const char* builtins[] = {"*", "+", "-", "max", "min"};
+    const char* generic[] = {"mul", "add", "sub", "max2", "min2"};
+    Interpreter interpreter;
+    interpreter.SetMemoThreshold(0);
+    interpreter.Register("mul", [](int64_t a, int64_t b) { return a * b; });
+    interpreter.Register("add", [](int64_t a, int64_t b) { return a + b; });
+    interpreter.Register("sub", [](int64_t a, int64_t b) { return a - b; });
+    interpreter.Register("max2", [](int64_t a, int64_t b) { return std::max(a, b); });
+    interpreter.Register("min2", [](int64_t a, int64_t b) { return std::min(a, b); });
+
+    std::vector<std::shared_ptr<Object>> fast;
+    std::vector<std::shared_ptr<Object>> slow;
+    std::mt19937_64 fast_random{1};
+    std::mt19937_64 slow_random{1};
+    for (int i = 0; i < 256; ++i) {
+        fast.push_back(Parse(BinaryTree(&fast_random, kDepth, builtins)));
+        slow.push_back(Parse(BinaryTree(&slow_random, kDepth, generic)));
+        if (interpreter.Run(fast.back()) != interpreter.Run(slow.back())) {
+            std::cerr << "bench: builtin and generic results differ\n";
+            return 1;
+        }
+    }
+    constexpr int kCalls = (1 << kDepth) - 1;
+    std::cout << "{\"bench\":\"calls\",\"calls_per_expression\":" << kCalls
+              << ",\"ns_per_call\":{\"builtin\":" << NsPerRun(&interpreter, fast) / kCalls
+              << ",\"generic\":" << NsPerRun(&interpreter, slow) / kCalls << "}}\n";
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        Usage();
+    }
+    std::string command = argv[1];
+    if (command == "image") {
+        size_t mb = 100;
+        std::string dir = "/tmp";
+        for (int i = 2; i < argc; ++i) {
+            std::string flag = argv[i];
+            if (i + 1 == argc) {
+                Usage();
+            }
+            const char* value = argv[++i];
+            if (flag == "--mb") {
+                mb = std::max(1l, std::atol(value));
+            } else if (flag == "--dir") {
+                dir = value;
+            } else {
+                Usage();
+            }
+        }
+        return Image(mb, dir);
+    }
+    if (argc != 2) {
+        Usage();
+    }
+    if (command == "cells") {
+        return Cells();
+    }
+    if (command == "vectors") {
+        return Vectors();
+    }
+    if (command == "bulk") {
+        return Bulk();
+    }
+    if (command == "calls") {
+        return Calls();
+    }
+    Usage();
+}
@@ -18,4 +18,10 @@ class NameError : public std::runtime_error {
 public:
     NameError() : std::runtime_error("name error") {
     }
-};
\ No newline at end of file
+};
+
+class LimitError : public std::runtime_error {
+public:
+    LimitError() : std::runtime_error("limit exceeded") {
+    }
+};
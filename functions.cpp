@@ -1,463 +1,823 @@
 #include "functions.h"
 #include "error.h"
+#include "hashtable.h"
+#include "macro.h"
+#include "parser.h"
 
-std::string QuoteFunction::ObjectHelper(std::shared_ptr<Object> obj) {
-    if (Is<Number>(obj)) {
-        return std::to_string(As<Number>(obj)->GetValue());
+#include <cmath>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+
+struct SlotRegistry {
+    std::mutex mutex;
+    std::unordered_map<std::string, int32_t> slots;
+};
+
+SlotRegistry& GetSlotRegistry() {
+    static SlotRegistry registry;
+    return registry;
+}
+
+}  // namespace
+
+int32_t FunctionSlot(const std::string& name) {
+    auto& registry = GetSlotRegistry();
+    std::lock_guard lock(registry.mutex);
+    return registry.slots.try_emplace(name, registry.slots.size()).first->second;
+}
+
+int32_t FindFunctionSlot(const std::string& name) {
+    auto& registry = GetSlotRegistry();
+    std::lock_guard lock(registry.mutex);
+    auto it = registry.slots.find(name);
+    return (it == registry.slots.end()) ? -1 : it->second;
+}
+
+std::string IAsyncFunction::Invoke(ArgSpan args) {
+    struct Completion {
+        bool done = false;
+        std::string result;
+        std::exception_ptr error;
+    };
+    auto completion = std::make_shared<Completion>();
+    Start(args, [completion](std::string result, std::exception_ptr error) {
+        completion->done = true;
+        completion->result = std::move(result);
+        completion->error = std::move(error);
+    });
+    if (!completion->done) {
+        throw RuntimeError();
+    }
+    if (completion->error) {
+        std::rethrow_exception(completion->error);
+    }
+    return std::move(completion->result);
+}
+
+BuiltinKind GetBuiltinKind(const IFunction* func) {
+    if (dynamic_cast<const IAsyncFunction*>(func)) {
+        return BuiltinKind::kAsync;
+    }
+    if (dynamic_cast<const QuoteFunction*>(func)) {
+        return BuiltinKind::kQuote;
+    }
+    if (dynamic_cast<const QuasiquoteFunction*>(func)) {
+        return BuiltinKind::kQuasiquote;
     }
-    if (Is<Bool>(obj)) {
-        return As<Bool>(obj)->GetBool() ? "#t" : "#f";
+    if (dynamic_cast<const AndFunction*>(func)) {
+        return BuiltinKind::kAnd;
+    }
+    if (dynamic_cast<const OrFunction*>(func)) {
+        return BuiltinKind::kOr;
+    }
+    if (dynamic_cast<const AddFunction*>(func)) {
+        return BuiltinKind::kAdd;
+    }
+    if (dynamic_cast<const SubstrFunction*>(func)) {
+        return BuiltinKind::kSubstract;
+    }
+    if (dynamic_cast<const MultiplyFunction*>(func)) {
+        return BuiltinKind::kMultiply;
+    }
+    if (dynamic_cast<const DivideFunction*>(func)) {
+        return BuiltinKind::kDivide;
+    }
+    if (dynamic_cast<const MaxFunction*>(func)) {
+        return BuiltinKind::kMax;
+    }
+    if (dynamic_cast<const MinFunction*>(func)) {
+        return BuiltinKind::kMin;
+    }
+    if (dynamic_cast<const EqFunction*>(func)) {
+        return BuiltinKind::kEq;
+    }
+    if (dynamic_cast<const LFunction*>(func)) {
+        return BuiltinKind::kLess;
+    }
+    if (dynamic_cast<const LEqFunction*>(func)) {
+        return BuiltinKind::kLessEq;
+    }
+    if (dynamic_cast<const GFunction*>(func)) {
+        return BuiltinKind::kGreater;
+    }
+    if (dynamic_cast<const GEqFunction*>(func)) {
+        return BuiltinKind::kGreaterEq;
+    }
+    if (dynamic_cast<const AbsFunction*>(func)) {
+        return BuiltinKind::kAbs;
+    }
+    if (dynamic_cast<const NotFunction*>(func)) {
+        return BuiltinKind::kNot;
+    }
+    return BuiltinKind::kGeneric;
+}
+
+bool InvokeBinary(BuiltinKind kind, int64_t a, int64_t b, std::string* out) {
+    switch (kind) {
+        case BuiltinKind::kAdd:
+            AppendNumber(AddOp::Apply(a, b), out);
+            return true;
+        case BuiltinKind::kSubstract:
+            AppendNumber(SubstractOp::Apply(a, b), out);
+            return true;
+        case BuiltinKind::kMultiply:
+            AppendNumber(MultiplyOp::Apply(a, b), out);
+            return true;
+        case BuiltinKind::kDivide:
+            AppendNumber(DivideOp::Apply(a, b), out);
+            return true;
+        case BuiltinKind::kMax:
+            AppendNumber(MaxOp::Apply(a, b), out);
+            return true;
+        case BuiltinKind::kMin:
+            AppendNumber(MinOp::Apply(a, b), out);
+            return true;
+        case BuiltinKind::kEq:
+            out->append(a == b ? "#t" : "#f");
+            return true;
+        case BuiltinKind::kLess:
+            out->append(a < b ? "#t" : "#f");
+            return true;
+        case BuiltinKind::kLessEq:
+            out->append(a <= b ? "#t" : "#f");
+            return true;
+        case BuiltinKind::kGreater:
+            out->append(a > b ? "#t" : "#f");
+            return true;
+        case BuiltinKind::kGreaterEq:
+            out->append(a >= b ? "#t" : "#f");
+            return true;
+        default:
+            return false;
     }
-    if (Is<Symbol>(obj)) {
-        return As<Symbol>(obj)->GetName();
+}
+
+static thread_local int64_t* allocation_budget = nullptr;
+
+void ChargeAllocation(size_t bytes) {
+    if (allocation_budget) {
+        // Compared before subtracting so a huge charge cannot wrap the signed budget.
+        if (*allocation_budget < 0 || bytes > static_cast<uint64_t>(*allocation_budget)) {
+            *allocation_budget = -1;
+            throw LimitError();
+        }
+        *allocation_budget -= bytes;
     }
-    return CellHelper(As<Cell>(obj));
 }
 
-std::string QuoteFunction::CellHelper(std::shared_ptr<Cell> cell) {
-    if (!cell->GetFirst()) {
-        return "()";
+int64_t* SetAllocationBudget(int64_t* budget) {
+    return std::exchange(allocation_budget, budget);
+}
+
+static thread_local const StepCounter* step_counter = nullptr;
+
+void ChargeStep() {
+    if (step_counter && --*step_counter->budget <= 0) {
+        step_counter->check();
     }
-    if (!cell->GetSecond()) {
-        return ObjectHelper(cell->GetFirst());
+}
+
+const StepCounter* SetStepCounter(const StepCounter* counter) {
+    return std::exchange(step_counter, counter);
+}
+
+std::shared_ptr<Object> IFunction::InvokeValue(ArgSpan args) {
+    auto res = Invoke(args);
+    ChargeAllocation(res.size());
+    return ReadValue(res);
+}
+
+std::string IObjectFunction::Invoke(ArgSpan args) {
+    std::string res;
+    InvokeTo(args, &res);
+    return res;
+}
+
+void IObjectFunction::InvokeTo(ArgSpan args, std::string* out) {
+    PrintDatum(InvokeValue(args).get(), out);
+}
+
+std::shared_ptr<Object> Procedure::Call(ArgSpan args) const {
+    ChargeStep();
+    return func_->InvokeValue(args);
+}
+
+static std::shared_ptr<Object> OrEmptyList(const std::shared_ptr<Object>& obj) {
+    return obj ? obj : EmptyList();
+}
+
+// Builds a list result, charged against the allocation budget.
+static std::shared_ptr<Object> MakeList(const std::vector<std::shared_ptr<Object>>& items,
+                                        std::shared_ptr<Object> tail = nullptr) {
+    if (items.empty() && !tail) {
+        return EmptyList();
     }
-    if (Is<Number>(cell->GetFirst()) && Is<Number>(cell->GetSecond())) {
-        return std::to_string(As<Number>(cell->GetFirst())->GetValue()) + " . " +
-               std::to_string(As<Number>(cell->GetSecond())->GetValue());
+    ChargeAllocation(items.size() * sizeof(Cell));
+    return RebuildList(items, std::move(tail));
+}
+
+// The list a list argument denotes, () being nullptr. Lists arrive as cells; one returned by a
+// builtin that only prints its result arrives as that text and is read back.
+static std::shared_ptr<Object> ListArg(const std::shared_ptr<Object>& obj) {
+    if (Is<Symbol>(obj) && As<Symbol>(obj)->GetName().starts_with('(')) {
+        std::stringstream in{As<Symbol>(obj)->GetName()};
+        Tokenizer tokenizer{&in};
+        return Read(&tokenizer);
     }
-    return ObjectHelper(cell->GetFirst()) + " " + ObjectHelper(cell->GetSecond());
+    return obj;
 }
 
-std::string QuoteFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
+std::shared_ptr<Object> QuoteFunction::InvokeValue(ArgSpan args) {
     if (args.size() != 1) {
         throw RuntimeError();
     }
-    if (args[0] == nullptr) {
-        return "()";
-    }
-    if (Is<Symbol>(args[0])) {
-        auto ptr = As<Symbol>(args[0]);
-        return ptr->GetName();
+    return OrEmptyList(args[0]);
+}
+
+std::string AbsFunction::Invoke(ArgSpan args) {
+    if (args.size() == 1 && Is<Flonum>(args[0])) {
+        std::string res;
+        AppendFlonum(std::fabs(As<Flonum>(args[0])->GetValue()), &res);
+        return res;
     }
-    if (Is<Bool>(args[0])) {
-        auto ptr = As<Bool>(args[0]);
-        return (ptr->GetBool()) ? "#t" : "#f";
+    if (args.size() != 1 || !Is<Number>(args[0])) {
+        throw RuntimeError();
     }
-    if (Is<Number>(args[0])) {
-        auto ptr = As<Number>(args[0]);
-        return std::to_string(ptr->GetValue());
+    int64_t value = As<Number>(args[0])->GetValue();
+    if (value == INT64_MIN) {
+        throw RuntimeError();
     }
-    return "(" + CellHelper(As<Cell>(args[0])) + ")";
+    return std::to_string(std::abs(value));
 }
 
-std::string AddFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    int64_t res = 0;
-    for (auto& arg : args) {
-        if (!arg || !Is<Number>(arg)) {
-            throw RuntimeError();
-        }
-        res += As<Number>(arg)->GetValue();
+std::string QuasiquoteFunction::Invoke(ArgSpan) {
+    throw RuntimeError();
+}
+
+std::string NumberFunction::Invoke(ArgSpan args) {
+    if (args.size() != 1) {
+        throw RuntimeError();
     }
-    return std::to_string(res);
+    return (Is<Number>(args[0]) || Is<Flonum>(args[0])) ? "#t" : "#f";
 }
 
-std::string MultiplyFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    int64_t res = 1;
-    for (auto& arg : args) {
-        if (!arg || !Is<Number>(arg)) {
-            throw RuntimeError();
-        }
-        res *= As<Number>(arg)->GetValue();
+std::string BoolFunction::Invoke(ArgSpan args) {
+    if (args.size() != 1 || !args[0]) {
+        throw RuntimeError();
     }
-    return std::to_string(res);
+    return (Is<Bool>(args[0]) ? "#t" : "#f");
 }
 
-std::string SubstrFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.empty() || !Is<Number>(args[0])) {
+std::string NotFunction::Invoke(ArgSpan args) {
+    if (args.size() != 1) {
         throw RuntimeError();
     }
-    int64_t res = As<Number>(args[0])->GetValue();
-    for (size_t i = 1; i < args.size(); ++i) {
-        if (!args[i] || !Is<Number>(args[i])) {
-            throw RuntimeError();
-        }
-        res -= As<Number>(args[i])->GetValue();
+    bool res = false;
+    if (args[0] && Is<Bool>(args[0]) && !As<Bool>(args[0])->GetBool()) {
+        res = true;
     }
-    return std::to_string(res);
+    return (res) ? "#t" : "#f";
 }
 
-std::string DivideFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.empty() || !Is<Number>(args[0])) {
+// The list argument of a list predicate; anything but a list or a symbol is an error.
+static std::shared_ptr<Object> PredicateArg(ArgSpan args) {
+    if (args.size() != 1 || !(Is<Symbol>(args[0]) || Is<Cell>(args[0]))) {
         throw RuntimeError();
     }
-    int64_t res = As<Number>(args[0])->GetValue();
-    for (size_t i = 1; i < args.size(); ++i) {
-        if (!args[i] || !Is<Number>(args[i])) {
-            throw RuntimeError();
-        }
-        res /= As<Number>(args[i])->GetValue();
+    return ListArg(args[0]);
+}
+
+std::string PairFunction::Invoke(ArgSpan args) {
+    std::vector<std::shared_ptr<Object>> items;
+    std::shared_ptr<Object> tail;
+    ListElements(PredicateArg(args), &items, &tail);
+    return items.size() + (tail ? 1 : 0) == 2 ? "#t" : "#f";
+}
+
+std::string ListFunction::Invoke(ArgSpan args) {
+    auto list = PredicateArg(args);
+    if (!list) {
+        return "#t";
     }
-    return std::to_string(res);
+    std::vector<std::shared_ptr<Object>> items;
+    std::shared_ptr<Object> tail;
+    ListElements(list, &items, &tail);
+    return !items.empty() && !tail ? "#t" : "#f";
 }
 
-std::string MaxFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.empty() || !Is<Number>(args[0])) {
-        throw RuntimeError();
+std::string NullFunction::Invoke(ArgSpan args) {
+    return PredicateArg(args) ? "#f" : "#t";
+}
+
+std::string AndFunction::Invoke(ArgSpan args) {
+    if (args.empty()) {
+        return "#t";
     }
-    int64_t res = As<Number>(args[0])->GetValue();
     for (auto& arg : args) {
-        if (!arg || !Is<Number>(arg)) {
-            throw RuntimeError();
+        if (arg && Is<Bool>(arg) && !As<Bool>(arg)->GetBool()) {
+            return "#f";
         }
-        res = std::max(res, As<Number>(arg)->GetValue());
     }
-    return std::to_string(res);
+    if (args.back()) {
+        return args.back()->ToString();
+    }
+    return "";
 }
 
-std::string MinFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.empty() || !Is<Number>(args[0])) {
-        throw RuntimeError();
+std::string OrFunction::Invoke(ArgSpan args) {
+    if (args.empty()) {
+        return "#f";
+    }
+    for (auto& arg : args) {
+        if (arg && Is<Bool>(arg) && As<Bool>(arg)->GetBool()) {
+            return "#t";
+        }
+    }
+    if (args.back()) {
+        return args.back()->ToString();
     }
-    int64_t res = As<Number>(args[0])->GetValue();
+    return "";
+}
+
+static void CheckNumbers(ArgSpan args) {
     for (auto& arg : args) {
-        if (!arg || !Is<Number>(arg)) {
+        if (!arg || !(Is<Number>(arg) || Is<Flonum>(arg))) {
             throw RuntimeError();
         }
-        res = std::min(res, As<Number>(arg)->GetValue());
     }
-    return std::to_string(res);
 }
 
-std::string AbsFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.size() != 1 || !Is<Number>(args[0])) {
-        throw RuntimeError();
+static void PrintNumbers(ArgSpan args, const char* delim, std::string* out) {
+    CheckNumbers(args);
+    out->push_back('(');
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (i > 0) {
+            out->append(delim);
+        }
+        args[i]->Print(out);
     }
-    int64_t res = std::abs(As<Number>(args[0])->GetValue());
-    return std::to_string(res);
+    out->push_back(')');
 }
 
-std::string NumberFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.size() != 1) {
+void MakeListFunction::InvokeTo(ArgSpan args, std::string* out) {
+    PrintNumbers(args, " ", out);
+}
+
+std::shared_ptr<Object> MakeListFunction::InvokeValue(ArgSpan args) {
+    CheckNumbers(args);
+    return MakeList({args.begin(), args.end()});
+}
+
+void ConsFunction::InvokeTo(ArgSpan args, std::string* out) {
+    if (args.size() != 2) {
         throw RuntimeError();
     }
-    return (Is<Number>(args[0])) ? "#t" : "#f";
+    PrintNumbers(args, " . ", out);
 }
 
-std::string EqFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    bool res = true;
-    if (!args.empty() && !Is<Number>(args[0])) {
+std::shared_ptr<Object> ConsFunction::InvokeValue(ArgSpan args) {
+    if (args.size() != 2) {
         throw RuntimeError();
     }
-    int64_t prev = 0;
-    if (!args.empty()) {
-        prev = As<Number>(args[0])->GetValue();
+    CheckNumbers(args);
+    ChargeAllocation(sizeof(Cell));
+    return std::make_shared<Cell>(args[0], args[1]);
+}
+
+// The pair a car or cdr argument denotes.
+static std::shared_ptr<Cell> PairArg(ArgSpan args) {
+    if (args.size() != 1) {
+        throw RuntimeError();
     }
-    for (size_t i = 1; i < args.size() && res; ++i) {
-        if (!args[i] || !Is<Number>(args[i])) {
-            throw RuntimeError();
-        }
-        int cur = As<Number>(args[i])->GetValue();
-        res = prev == cur;
-        prev = cur;
+    auto obj = ListArg(args[0]);
+    if (!Is<Cell>(obj) || !As<Cell>(obj)->GetFirst()) {
+        throw RuntimeError();
     }
-    return (res) ? "#t" : "#f";
+    return As<Cell>(obj);
 }
 
-std::string LFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    bool res = true;
-    if (!args.empty() && !Is<Number>(args[0])) {
+std::shared_ptr<Object> CarFunction::InvokeValue(ArgSpan args) {
+    return OrEmptyList(PairArg(args)->GetFirst());
+}
+
+std::shared_ptr<Object> CdrFunction::InvokeValue(ArgSpan args) {
+    return OrEmptyList(PairArg(args)->GetSecond());
+}
+
+// The rest of a list-ref or list-tail list after skipping as many items as the index says.
+static std::shared_ptr<Object> ListTail(ArgSpan args) {
+    if (args.size() != 2 || !Is<Number>(args[1]) || As<Number>(args[1])->GetValue() < 0) {
         throw RuntimeError();
     }
-    int64_t prev = 0;
-    if (!args.empty()) {
-        prev = As<Number>(args[0])->GetValue();
-    }
-    for (size_t i = 1; i < args.size() && res; ++i) {
-        if (!args[i] || !Is<Number>(args[i])) {
+    auto list = ListArg(args[0]);
+    for (int64_t i = As<Number>(args[1])->GetValue(); i > 0; --i) {
+        if (!Is<Cell>(list)) {
             throw RuntimeError();
         }
-        int cur = As<Number>(args[i])->GetValue();
-        res = prev < cur;
-        prev = cur;
+        list = As<Cell>(list)->GetSecond();
     }
-    return (res) ? "#t" : "#f";
+    return list;
 }
 
-std::string LEqFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    bool res = true;
-    if (!args.empty() && !Is<Number>(args[0])) {
+std::shared_ptr<Object> RefFunction::InvokeValue(ArgSpan args) {
+    auto list = ListTail(args);
+    if (!Is<Cell>(list)) {
         throw RuntimeError();
     }
-    int64_t prev = 0;
-    if (!args.empty()) {
-        prev = As<Number>(args[0])->GetValue();
+    return OrEmptyList(As<Cell>(list)->GetFirst());
+}
+
+std::shared_ptr<Object> TailFunction::InvokeValue(ArgSpan args) {
+    auto list = ListTail(args);
+    if (list && !Is<Cell>(list)) {
+        throw RuntimeError();
     }
-    for (size_t i = 1; i < args.size() && res; ++i) {
-        if (!args[i] || !Is<Number>(args[i])) {
-            throw RuntimeError();
-        }
-        int cur = As<Number>(args[i])->GetValue();
-        res = prev <= cur;
-        prev = cur;
+    return OrEmptyList(list);
+}
+
+static size_t GetIndex(const std::shared_ptr<Object>& obj, size_t size) {
+    if (!Is<Number>(obj)) {
+        throw RuntimeError();
     }
-    return (res) ? "#t" : "#f";
+    int64_t index = As<Number>(obj)->GetValue();
+    if (index < 0 || static_cast<size_t>(index) >= size) {
+        throw RuntimeError();
+    }
+    return index;
 }
 
-std::string GFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    bool res = true;
-    if (!args.empty() && !Is<Number>(args[0])) {
+std::shared_ptr<Object> MakeVectorFunction::InvokeValue(ArgSpan args) {
+    if (args.empty() || args.size() > 2 || !Is<Number>(args[0])) {
         throw RuntimeError();
     }
-    int64_t prev = 0;
-    if (!args.empty()) {
-        prev = As<Number>(args[0])->GetValue();
+    int64_t size = As<Number>(args[0])->GetValue();
+    if (size < 0 || size > kMaxVectorSize) {
+        throw RuntimeError();
     }
-    for (size_t i = 1; i < args.size() && res; ++i) {
-        if (!args[i] || !Is<Number>(args[i])) {
-            throw RuntimeError();
-        }
-        int cur = As<Number>(args[i])->GetValue();
-        res = prev > cur;
-        prev = cur;
+    ChargeAllocation(size * (sizeof(std::shared_ptr<Object>) + 2));
+    auto fill = (args.size() == 2) ? args[1] : std::make_shared<Number>(0);
+    return std::make_shared<Vector>(std::vector<std::shared_ptr<Object>>(size, fill));
+}
+
+std::shared_ptr<Object> VectorRefFunction::InvokeValue(ArgSpan args) {
+    if (args.size() != 2 || !Is<Vector>(args[0])) {
+        throw RuntimeError();
     }
-    return (res) ? "#t" : "#f";
+    auto vec = static_cast<const Vector*>(args[0].get());
+    return OrEmptyList(vec->Get(GetIndex(args[1], vec->Size())));
 }
 
-std::string GEqFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    bool res = true;
-    if (!args.empty() && !Is<Number>(args[0])) {
+std::shared_ptr<Object> VectorSetFunction::InvokeValue(ArgSpan args) {
+    if (args.size() != 3 || !Is<Vector>(args[0])) {
         throw RuntimeError();
     }
-    int64_t prev = 0;
-    if (!args.empty()) {
-        prev = As<Number>(args[0])->GetValue();
+    auto vec = static_cast<Vector*>(args[0].get());
+    size_t index = GetIndex(args[1], vec->Size());
+    if (args[0].use_count() == 1) {
+        vec->Set(index, args[2]);
+        return args[0];
     }
-    for (size_t i = 1; i < args.size() && res; ++i) {
-        if (!args[i] || !Is<Number>(args[i])) {
-            throw RuntimeError();
-        }
-        int cur = As<Number>(args[i])->GetValue();
-        res = prev >= cur;
-        prev = cur;
+    ChargeAllocation(vec->Size() * sizeof(std::shared_ptr<Object>));
+    auto copy = std::make_shared<Vector>(vec->GetItems());
+    copy->Set(index, args[2]);
+    return copy;
+}
+
+std::string VectorLengthFunction::Invoke(ArgSpan args) {
+    if (args.size() != 1 || !Is<Vector>(args[0])) {
+        throw RuntimeError();
     }
-    return (res) ? "#t" : "#f";
+    return std::to_string(As<Vector>(args[0])->Size());
 }
 
-std::string BoolFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.size() != 1 || !args[0]) {
+std::shared_ptr<Object> VectorMapFunction::InvokeValue(ArgSpan args) {
+    if (args.size() != 2 || !Is<Procedure>(args[0]) || !Is<Vector>(args[1])) {
         throw RuntimeError();
     }
-    return (Is<Bool>(args[0]) ? "#t" : "#f");
+    auto func = As<Procedure>(args[0]);
+    auto vec = As<Vector>(args[1]);
+    ChargeAllocation(vec->Size() * sizeof(std::shared_ptr<Object>));
+    std::vector<std::shared_ptr<Object>> items;
+    items.reserve(vec->Size());
+    std::vector<std::shared_ptr<Object>> call(1);
+    for (auto& item : vec->GetItems()) {
+        call[0] = item;
+        items.push_back(func->Call(call));
+    }
+    return std::make_shared<Vector>(std::move(items));
 }
 
-std::string NotFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.size() != 1) {
+std::shared_ptr<Object> VectorFoldFunction::InvokeValue(ArgSpan args) {
+    if (args.size() != 3 || !Is<Procedure>(args[0]) || !Is<Vector>(args[2])) {
         throw RuntimeError();
     }
-    bool res = false;
-    if (args[0] && Is<Bool>(args[0]) && !As<Bool>(args[0])->GetBool()) {
-        res = true;
+    auto func = As<Procedure>(args[0]);
+    std::vector<std::shared_ptr<Object>> call{args[1], nullptr};
+    for (auto& item : As<Vector>(args[2])->GetItems()) {
+        call[1] = item;
+        call[0] = func->Call(call);
     }
-    return (res) ? "#t" : "#f";
+    return OrEmptyList(call[0]);
 }
 
-std::string PairFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.size() != 1 || !Is<Symbol>(args[0])) {
+std::shared_ptr<Object> MakeHashTableFunction::InvokeValue(ArgSpan args) {
+    if (!args.empty()) {
         throw RuntimeError();
     }
-    auto str = As<Symbol>(args[0])->GetName();
-    bool res = true;
-    if (str.front() != '(' || str.back() != ')') {
-        res = false;
+    return std::make_shared<HashTable>();
+}
+
+// Adds the (key . value) pairs of an association list.
+static void FillHashTable(const std::shared_ptr<Object>& alist, HashTable* table) {
+    auto cur = ListArg(alist);
+    if (cur && !Is<Cell>(cur)) {
+        throw RuntimeError();
     }
-    size_t count = 0;
-    bool del = true;
-    for (size_t i = 1; i < str.size() - 1 && res; ++i) {
-        if (std::isdigit(str[i])) {
-            if (del) {
-                del = false;
-                ++count;
-            }
-        } else if (str[i] == ' ' || str[i] == '.') {
-            del = true;
+    std::vector<const Cell*> pairs;
+    while (cur) {
+        auto cell = dynamic_cast<const Cell*>(cur.get());
+        if (!cell || !Is<Cell>(cell->GetFirst())) {
+            throw RuntimeError();
         }
+        pairs.push_back(static_cast<const Cell*>(cell->GetFirst().get()));
+        cur = cell->GetSecond();
     }
-    if (count != 2) {
-        res = false;
+    table->Reserve(table->Size() + pairs.size());
+    for (auto pair : pairs) {
+        table->Set(pair->GetFirst(), pair->GetSecond());
     }
-    return (res) ? "#t" : "#f";
 }
 
-std::string ListFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.size() != 1 || !Is<Symbol>(args[0])) {
+std::shared_ptr<Object> AlistToHashTableFunction::InvokeValue(ArgSpan args) {
+    if (args.size() != 1) {
         throw RuntimeError();
     }
-    return (As<Symbol>(args[0])->GetName().find(".") == std::string::npos) ? "#t" : "#f";
+    auto table = std::make_shared<HashTable>();
+    FillHashTable(args[0], table.get());
+    ChargeAllocation(table->Size() * sizeof(HashEntry));
+    return table;
 }
 
-std::string NullFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.size() != 1 || !Is<Symbol>(args[0])) {
+std::shared_ptr<Object> HashRefFunction::InvokeValue(ArgSpan args) {
+    if (args.size() < 2 || args.size() > 3 || !Is<HashTable>(args[0])) {
+        throw RuntimeError();
+    }
+    auto value = static_cast<const HashTable*>(args[0].get())->Find(args[1]);
+    if (!value && args.size() == 2) {
         throw RuntimeError();
     }
-    return (As<Symbol>(args[0])->GetName() == "()") ? "#t" : "#f";
+    return OrEmptyList(value ? *value : args[2]);
 }
 
-std::string AndFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.empty()) {
-        return "#t";
-    }
-    for (auto& arg : args) {
-        if (arg && Is<Bool>(arg) && !As<Bool>(arg)->GetBool()) {
-            return "#f";
-        }
+std::shared_ptr<Object> HashSetFunction::InvokeValue(ArgSpan args) {
+    if (args.size() != 3 || !Is<HashTable>(args[0])) {
+        throw RuntimeError();
     }
-    if (args.back()) {
-        return args.back()->ToString();
+    auto table = static_cast<HashTable*>(args[0].get());
+    if (args[0].use_count() == 1) {
+        table->Set(args[1], args[2]);
+        return args[0];
     }
-    return "";
+    ChargeAllocation(table->Size() * sizeof(HashEntry));
+    auto copy = std::make_shared<HashTable>(*table);
+    copy->Set(args[1], args[2]);
+    return copy;
 }
 
-std::string OrFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.empty()) {
-        return "#f";
-    }
-    for (auto& arg : args) {
-        if (arg && Is<Bool>(arg) && As<Bool>(arg)->GetBool()) {
-            return "#t";
-        }
-    }
-    if (args.back()) {
-        return args.back()->ToString();
+std::string HashCountFunction::Invoke(ArgSpan args) {
+    if (args.size() != 1 || !Is<HashTable>(args[0])) {
+        throw RuntimeError();
     }
-    return "";
+    return std::to_string(As<HashTable>(args[0])->Size());
 }
 
-std::string MakeListFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
+std::string StringAppendFunction::Invoke(ArgSpan args) {
     std::string res;
     for (auto& arg : args) {
-        if (!arg || !Is<Number>(arg)) {
+        if (!Is<String>(arg)) {
             throw RuntimeError();
         }
-        res += arg->ToString() + ' ';
+        res += As<String>(arg)->GetValue();
     }
-    if (!res.empty()) {
-        res.pop_back();
-    }
-    return "(" + res + ")";
+    return String{res}.ToString();
 }
 
-std::string ConsFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    std::string res;
-    for (auto& arg : args) {
-        if (!arg || !Is<Number>(arg)) {
-            throw RuntimeError();
-        }
-        res += arg->ToString() + " . ";
+std::string SubstringFunction::Invoke(ArgSpan args) {
+    if (args.size() < 2 || args.size() > 3 || !Is<String>(args[0])) {
+        throw RuntimeError();
     }
-    if (!res.empty()) {
-        res = res.substr(0, res.size() - 3);
+    auto& str = As<String>(args[0])->GetValue();
+    size_t start = GetIndex(args[1], str.size() + 1);
+    size_t end = (args.size() == 3) ? GetIndex(args[2], str.size() + 1) : str.size();
+    if (start > end) {
+        throw RuntimeError();
     }
-    return "(" + res + ")";
+    return String{str.substr(start, end - start)}.ToString();
 }
 
-std::string CarFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.size() != 1 || !args[0] || args[0]->ToString() == "()") {
+// Items of a list argument.
+static std::vector<std::shared_ptr<Object>> ListItems(const std::shared_ptr<Object>& obj) {
+    auto list = ListArg(obj);
+    if (!obj || (list && !Is<Cell>(list))) {
         throw RuntimeError();
     }
-    std::string cur = args[0]->ToString();
-    std::string res;
-    for (size_t i = 1; i < cur.size() - 1; ++i) {
-        if (std::isdigit(cur[i])) {
-            res += cur[i];
-        } else {
-            break;
+    std::vector<std::shared_ptr<Object>> res;
+    while (list) {
+        if (!Is<Cell>(list)) {
+            throw RuntimeError();
         }
+        auto cell = static_cast<const Cell*>(list.get());
+        res.push_back(cell->GetFirst());
+        list = cell->GetSecond();
     }
     return res;
 }
 
-std::string CdrFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.size() != 1 || !args[0] || args[0]->ToString() == "()") {
-        throw RuntimeError();
+template <class Op>
+static bool FoldFused(ArgSpan args, int64_t* res) {
+    if (args.empty()) {
+        if constexpr (Op::kHasIdentity) {
+            *res = Op::kIdentity;
+            return true;
+        }
+        return false;
+    }
+    return FoldFunction<Op>::FoldFixnums(args, res) == args.size();
+}
+
+// Applies an arithmetic builtin to fixnum arguments without printing the result. Returns false
+// for other builtins and argument types, which go through the regular call.
+static bool FusedApply(const IFunction* func, ArgSpan args, int64_t* res) {
+    if (dynamic_cast<const AddFunction*>(func)) {
+        return FoldFused<AddOp>(args, res);
+    }
+    if (dynamic_cast<const MultiplyFunction*>(func)) {
+        return FoldFused<MultiplyOp>(args, res);
+    }
+    if (dynamic_cast<const SubstrFunction*>(func)) {
+        return FoldFused<SubstractOp>(args, res);
+    }
+    if (dynamic_cast<const MaxFunction*>(func)) {
+        return FoldFused<MaxOp>(args, res);
     }
-    std::string cur = args[0]->ToString();
-    if (cur.find(' ') == cur.npos) {
-        return "()";
+    if (dynamic_cast<const MinFunction*>(func)) {
+        return FoldFused<MinOp>(args, res);
     }
-    if (cur.find('.') != cur.npos && cur.find(' ') + 1 == cur.find('.')) {
-        cur.pop_back();
-        return cur.substr(cur.find('.') + 2, cur.size());
+    if (dynamic_cast<const AbsFunction*>(func) && args.size() == 1 && Is<Number>(args[0]) &&
+        As<Number>(args[0])->GetValue() != INT64_MIN) {
+        *res = std::abs(As<Number>(args[0])->GetValue());
+        return true;
     }
-    return "(" + cur.substr(cur.find(' ') + 1, cur.size());
+    return false;
 }
 
-std::string RefFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.size() != 2 || !Is<Symbol>(args[0]) || !Is<Number>(args[1])) {
-        throw RuntimeError();
+static std::shared_ptr<Object> Apply(const Procedure& proc,
+                                     ArgSpan args) {
+    int64_t res;
+    if (FusedApply(proc.GetFunction().get(), args, &res)) {
+        // Charged like the call it replaces.
+        ChargeStep();
+        return std::make_shared<Number>(res);
     }
-    auto str = As<Symbol>(args[0])->GetName();
-    int64_t num = As<Number>(args[1])->GetValue();
+    return proc.Call(args);
+}
 
-    if (str.front() != '(' || str.back() != ')') {
+static std::vector<std::vector<std::shared_ptr<Object>>> ListArgs(
+    ArgSpan args, size_t from, size_t* size) {
+    std::vector<std::vector<std::shared_ptr<Object>>> lists;
+    *size = SIZE_MAX;
+    for (size_t i = from; i < args.size(); ++i) {
+        lists.push_back(ListItems(args[i]));
+        *size = std::min(*size, lists.back().size());
+    }
+    return lists;
+}
+
+std::shared_ptr<Object> MapFunction::InvokeValue(ArgSpan args) {
+    if (args.size() < 2 || !Is<Procedure>(args[0])) {
         throw RuntimeError();
     }
-    int64_t count = 0;
-    std::string res;
-    bool del = true;
-    for (size_t i = 1; i < str.size() - 1; ++i) {
-        if (std::isdigit(str[i])) {
-            if (del) {
-                del = false;
-                ++count;
-            }
-            if (count - 1 == num) {
-                res += str[i];
-            }
-        } else if (str[i] == ' ' || str[i] == '.') {
-            del = true;
-            if (count - 1 == num) {
-                break;
-            }
+    auto func = As<Procedure>(args[0]);
+    size_t size;
+    auto lists = ListArgs(args, 1, &size);
+    std::vector<std::shared_ptr<Object>> res;
+    res.reserve(size);
+    std::vector<std::shared_ptr<Object>> call(lists.size());
+    for (size_t i = 0; i < size; ++i) {
+        for (size_t j = 0; j < lists.size(); ++j) {
+            call[j] = lists[j][i];
         }
+        res.push_back(Apply(*func, call));
     }
-    if (res.empty()) {
+    return MakeList(res);
+}
+
+std::shared_ptr<Object> FilterFunction::InvokeValue(ArgSpan args) {
+    if (args.size() != 2 || !Is<Procedure>(args[0])) {
         throw RuntimeError();
     }
-    return res;
+    auto func = As<Procedure>(args[0]);
+    std::vector<std::shared_ptr<Object>> res;
+    std::vector<std::shared_ptr<Object>> call(1);
+    for (auto& item : ListItems(args[1])) {
+        call[0] = item;
+        auto keep = func->Call(call);
+        if (!Is<Bool>(keep) || As<Bool>(keep)->GetBool()) {
+            res.push_back(item);
+        }
+    }
+    return MakeList(res);
 }
 
-std::string TailFunction::Invoke(const std::vector<std::shared_ptr<Object>>& args) {
-    if (args.size() != 2 || !Is<Symbol>(args[0]) || !Is<Number>(args[1])) {
+std::shared_ptr<Object> FoldLeftFunction::InvokeValue(ArgSpan args) {
+    if (args.size() < 3 || !Is<Procedure>(args[0])) {
         throw RuntimeError();
     }
-    auto str = As<Symbol>(args[0])->GetName();
-    int64_t num = As<Number>(args[1])->GetValue();
+    auto func = As<Procedure>(args[0]);
+    size_t size;
+    auto lists = ListArgs(args, 2, &size);
+    std::vector<std::shared_ptr<Object>> call(lists.size() + 1);
+    call[0] = args[1];
+    for (size_t i = 0; i < size; ++i) {
+        for (size_t j = 0; j < lists.size(); ++j) {
+            call[j + 1] = lists[j][i];
+        }
+        call[0] = Apply(*func, call);
+    }
+    return OrEmptyList(call[0]);
+}
 
-    if (str.front() != '(' || str.back() != ')') {
+std::shared_ptr<Object> FoldRightFunction::InvokeValue(ArgSpan args) {
+    if (args.size() < 3 || !Is<Procedure>(args[0])) {
         throw RuntimeError();
     }
-    int64_t count = 0;
-    std::string res;
-    bool del = true;
-    for (size_t i = 1; i < str.size() - 1; ++i) {
-        if (std::isdigit(str[i])) {
-            if (del) {
-                del = false;
-                ++count;
-            }
-            if (count - 1 >= num) {
-                res += str[i];
-            }
-        } else if (str[i] == ' ' || str[i] == '.') {
-            del = true;
-            if (count - 1 >= num) {
-                res += str[i];
-            }
+    auto func = As<Procedure>(args[0]);
+    size_t size;
+    auto lists = ListArgs(args, 2, &size);
+    std::vector<std::shared_ptr<Object>> call(lists.size() + 1);
+    call.back() = args[1];
+    for (size_t i = size; i > 0; --i) {
+        for (size_t j = 0; j < lists.size(); ++j) {
+            call[j] = lists[j][i - 1];
         }
+        call.back() = Apply(*func, call);
+    }
+    return OrEmptyList(call.back());
+}
+
+// The procedure and the spread argument list of an apply call.
+static std::shared_ptr<Procedure> ApplyArgs(ArgSpan args,
+                                            std::vector<std::shared_ptr<Object>>* call) {
+    if (args.size() < 2 || !Is<Procedure>(args[0])) {
+        throw RuntimeError();
+    }
+    call->assign(args.begin() + 1, args.end() - 1);
+    for (auto& item : ListItems(args.back())) {
+        call->push_back(item);
     }
-    if (res.empty() && count < num) {
+    return As<Procedure>(args[0]);
+}
+
+void ApplyFunction::InvokeTo(ArgSpan args, std::string* out) {
+    std::vector<std::shared_ptr<Object>> call;
+    auto func = ApplyArgs(args, &call);
+    int64_t value;
+    if (FusedApply(func->GetFunction().get(), call, &value)) {
+        AppendNumber(value, out);
+        return;
+    }
+    func->GetFunction()->InvokeTo(call, out);
+}
+
+std::shared_ptr<Object> ApplyFunction::InvokeValue(ArgSpan args) {
+    std::vector<std::shared_ptr<Object>> call;
+    auto func = ApplyArgs(args, &call);
+    return Apply(*func, call);
+}
+
+std::string LengthFunction::Invoke(ArgSpan args) {
+    if (args.size() != 1) {
         throw RuntimeError();
     }
+    return std::to_string(ListItems(args[0]).size());
+}
+
+std::shared_ptr<Object> AppendFunction::InvokeValue(ArgSpan args) {
+    std::vector<std::shared_ptr<Object>> res;
+    for (auto& arg : args) {
+        auto items = ListItems(arg);
+        res.insert(res.end(), items.begin(), items.end());
+    }
+    return MakeList(res);
+}
 
-    return "(" + res + ")";
+std::shared_ptr<Object> ReverseFunction::InvokeValue(ArgSpan args) {
+    if (args.size() != 1) {
+        throw RuntimeError();
+    }
+    auto items = ListItems(args[0]);
+    return MakeList({items.rbegin(), items.rend()});
 }
@@ -1,149 +1,761 @@
 #pragma once
 
+#include "error.h"
 #include "object.h"
 
+#include <algorithm>
+#include <cmath>
+#include <compare>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <span>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+using ArgSpan = std::span<const std::shared_ptr<Object>>;
+
+enum class BuiltinKind {
+    kGeneric,
+    kQuote,
+    kAnd,
+    kOr,
+    kAdd,
+    kSubstract,
+    kMultiply,
+    kDivide,
+    kMax,
+    kMin,
+    kEq,
+    kLess,
+    kLessEq,
+    kGreater,
+    kGreaterEq,
+    kAbs,
+    kNot,
+    kAsync,
+    kQuasiquote
+};
+
+int32_t FunctionSlot(const std::string& name);
+
+int32_t FindFunctionSlot(const std::string& name);
+
+void ChargeAllocation(size_t bytes);
+
+// Installs the byte budget ChargeAllocation draws from on this thread, nullptr for none, and
+// returns the previous one for the caller to put back.
+int64_t* SetAllocationBudget(int64_t* budget);
+
+// Step budget of the running evaluation. It is counted down per step, and check runs once it is
+// used up, either refilling it or throwing LimitError.
+struct StepCounter {
+    int64_t* budget;
+    std::function<void()> check;
+};
+
+// Charges one evaluation step for a call a builtin makes itself, such as map applying its
+// procedure, so step limits and cancellation also hold inside native loops.
+void ChargeStep();
+
+// Installs the counter ChargeStep draws from on this thread, nullptr for none, and returns the
+// previous one for the caller to put back.
+const StepCounter* SetStepCounter(const StepCounter* counter);
+
 class IFunction {
 public:
     virtual ~IFunction() = default;
-    virtual std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) = 0;
+    virtual std::string Invoke(ArgSpan args) = 0;
+    virtual void InvokeTo(ArgSpan args, std::string* out) {
+        out->append(Invoke(args));
+    }
+    // The result as an object, for arguments and procedure calls. By default the printed result
+    // is read back.
+    virtual std::shared_ptr<Object> InvokeValue(ArgSpan args);
+    virtual bool TakesProcedures() const {
+        return false;
+    }
 };
 
-class QuoteFunction : public IFunction {
+// A builtin that builds its result as an object, such as a list. Callers inside an evaluation take
+// the object itself, so nested results never round-trip through text; only the final result is
+// printed.
+class IObjectFunction : public IFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
-
-private:
-    std::string CellHelper(std::shared_ptr<Cell> cell);
-    std::string ObjectHelper(std::shared_ptr<Object> obj);
+    std::string Invoke(ArgSpan args) override;
+    void InvokeTo(ArgSpan args, std::string* out) override;
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override = 0;
 };
 
-class AddFunction : public IFunction {
+// The empty list as a runtime value. Lists are passed as cells, but () has none and keeps the
+// form its printed text reads back to.
+inline std::shared_ptr<Object> EmptyList() {
+    return std::make_shared<Symbol>("()");
+}
+
+inline bool IsEmptyList(const std::shared_ptr<Object>& obj) {
+    auto symbol = dynamic_cast<const Symbol*>(obj.get());
+    return !obj || (symbol && symbol->GetName() == "()");
+}
+
+using AsyncCallback = std::function<void(std::string result, std::exception_ptr error)>;
+
+// A builtin whose result arrives later. Start must copy whatever it needs from args and call
+// done exactly once, on the thread that drives the evaluation. Under a blocking Run the call
+// must complete inside Start.
+class IAsyncFunction : public IFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    virtual void Start(ArgSpan args, AsyncCallback done) = 0;
+    std::string Invoke(ArgSpan args) override;
 };
 
-class MultiplyFunction : public IFunction {
-public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+BuiltinKind GetBuiltinKind(const IFunction* func);
+
+bool InvokeBinary(BuiltinKind kind, int64_t a, int64_t b, std::string* out);
+
+struct Builtin {
+    std::shared_ptr<IFunction> func;
+    BuiltinKind kind = BuiltinKind::kGeneric;
 };
 
-class SubstrFunction : public IFunction {
+using FunctionTable = std::vector<Builtin>;
+
+class Procedure : public Object {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    Procedure(const std::string& name, std::shared_ptr<IFunction> func)
+        : name_(name), func_(std::move(func)) {
+        CountAllocation(ObjectType::kProcedure, sizeof(Procedure) + HeapBytes(name_), this);
+    }
+
+    ~Procedure() override {
+        CountRelease(ObjectType::kProcedure, sizeof(Procedure) + HeapBytes(name_), this);
+    }
+
+    std::shared_ptr<Object> Call(ArgSpan args) const;
+
+    const std::shared_ptr<IFunction>& GetFunction() const {
+        return func_;
+    }
+
+    void Print(std::string* out) const override {
+        out->append(name_);
+    }
+
+private:
+    std::string name_;
+    std::shared_ptr<IFunction> func_;
 };
 
-class DivideFunction : public IFunction {
+class QuoteFunction : public IObjectFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
 };
 
-class MaxFunction : public IFunction {
-public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+inline int64_t UnboxNumber(const std::shared_ptr<Object>& arg) {
+    auto number = dynamic_cast<const Number*>(arg.get());
+    if (!number) {
+        throw RuntimeError();
+    }
+    return number->GetValue();
+}
+
+inline double UnboxReal(const std::shared_ptr<Object>& arg) {
+    if (auto number = dynamic_cast<const Number*>(arg.get())) {
+        return number->GetValue();
+    }
+    auto flonum = dynamic_cast<const Flonum*>(arg.get());
+    if (!flonum) {
+        throw RuntimeError();
+    }
+    return flonum->GetValue();
+}
+
+// Exact ordering of two reals. A fixnum and a flonum compare by value rather than through a
+// double conversion, which would round fixnums beyond 2^53; NaN is unordered with everything.
+inline std::partial_ordering CompareReals(const std::shared_ptr<Object>& lhs,
+                                          const std::shared_ptr<Object>& rhs) {
+    auto a = dynamic_cast<const Number*>(lhs.get());
+    auto b = dynamic_cast<const Number*>(rhs.get());
+    if (a && b) {
+        return a->GetValue() <=> b->GetValue();
+    }
+    if (!a && !b) {
+        return UnboxReal(lhs) <=> UnboxReal(rhs);
+    }
+    int64_t fixnum = a ? a->GetValue() : b->GetValue();
+    double real = UnboxReal(a ? rhs : lhs);
+    std::partial_ordering res = std::partial_ordering::unordered;
+    if (std::isnan(real)) {
+        return res;
+    }
+    // 2^63 is exact as a double; every double in [-2^63, 2^63) truncates to a valid int64_t.
+    constexpr double kLimit = 9223372036854775808.0;
+    if (real >= kLimit) {
+        res = std::partial_ordering::less;
+    } else if (real < -kLimit) {
+        res = std::partial_ordering::greater;
+    } else {
+        double whole = std::trunc(real);
+        auto truncated = static_cast<int64_t>(whole);
+        res = fixnum != truncated ? fixnum <=> truncated : 0.0 <=> real - whole;
+    }
+    // res orders the fixnum against the flonum; flip it when the flonum came first.
+    return a ? res : 0 <=> res;
+}
+
+struct AddOp {
+    static constexpr bool kHasIdentity = true;
+    static constexpr int64_t kIdentity = 0;
+
+    static int64_t Apply(int64_t a, int64_t b) {
+        int64_t res;
+        if (__builtin_add_overflow(a, b, &res)) {
+            throw RuntimeError();
+        }
+        return res;
+    }
+
+    static double Apply(double a, double b) {
+        return a + b;
+    }
 };
 
-class MinFunction : public IFunction {
-public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+struct MultiplyOp {
+    static constexpr bool kHasIdentity = true;
+    static constexpr int64_t kIdentity = 1;
+
+    static int64_t Apply(int64_t a, int64_t b) {
+        int64_t res;
+        if (__builtin_mul_overflow(a, b, &res)) {
+            throw RuntimeError();
+        }
+        return res;
+    }
+
+    static double Apply(double a, double b) {
+        return a * b;
+    }
 };
 
-class AbsFunction : public IFunction {
-public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+struct SubstractOp {
+    static constexpr bool kHasIdentity = false;
+
+    static int64_t Apply(int64_t a, int64_t b) {
+        int64_t res;
+        if (__builtin_sub_overflow(a, b, &res)) {
+            throw RuntimeError();
+        }
+        return res;
+    }
+
+    static double Apply(double a, double b) {
+        return a - b;
+    }
 };
 
-class NumberFunction : public IFunction {
-public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+struct DivideOp {
+    static constexpr bool kHasIdentity = false;
+
+    static int64_t Apply(int64_t a, int64_t b) {
+        if (b == 0 || (a == INT64_MIN && b == -1)) {
+            throw RuntimeError();
+        }
+        return a / b;
+    }
+
+    static double Apply(double a, double b) {
+        if (b == 0) {
+            throw RuntimeError();
+        }
+        return a / b;
+    }
+};
+
+struct MaxOp {
+    static constexpr bool kHasIdentity = false;
+
+    static int64_t Apply(int64_t a, int64_t b) {
+        return std::max(a, b);
+    }
+
+    static double Apply(double a, double b) {
+        return std::max(a, b);
+    }
+};
+
+struct MinOp {
+    static constexpr bool kHasIdentity = false;
+
+    static int64_t Apply(int64_t a, int64_t b) {
+        return std::min(a, b);
+    }
+
+    static double Apply(double a, double b) {
+        return std::min(a, b);
+    }
 };
 
-class EqFunction : public IFunction {
+// Left fold over numeric arguments. Ops without an identity reject an empty argument list. The
+// fold stays on fixnums until the first flonum, which turns the rest of it into doubles.
+template <class Op>
+class FoldFunction : public IFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::string Invoke(ArgSpan args) override {
+        std::string res;
+        InvokeTo(args, &res);
+        return res;
+    }
+
+    void InvokeTo(ArgSpan args, std::string* out) override {
+        if (args.empty()) {
+            if constexpr (Op::kHasIdentity) {
+                AppendNumber(Op::kIdentity, out);
+                return;
+            }
+            throw RuntimeError();
+        }
+        int64_t fixnum = 0;
+        size_t i = FoldFixnums(args, &fixnum);
+        if (i == args.size()) {
+            AppendNumber(fixnum, out);
+            return;
+        }
+        double real = i > 0 ? fixnum : UnboxReal(args[0]);
+        for (i = std::max<size_t>(i, 1); i < args.size(); ++i) {
+            real = Op::Apply(real, UnboxReal(args[i]));
+        }
+        AppendFlonum(real, out);
+    }
+
+    // Folds the leading fixnums of args into *res and returns how many it folded, zero when the
+    // first argument is not a fixnum.
+    static size_t FoldFixnums(ArgSpan args, int64_t* res) {
+        size_t i = 0;
+        for (; i < args.size(); ++i) {
+            auto number = dynamic_cast<const Number*>(args[i].get());
+            if (!number) {
+                break;
+            }
+            *res = i == 0 ? number->GetValue() : Op::Apply(*res, number->GetValue());
+        }
+        return i;
+    }
 };
 
-class LFunction : public IFunction {
+using AddFunction = FoldFunction<AddOp>;
+using MultiplyFunction = FoldFunction<MultiplyOp>;
+using SubstrFunction = FoldFunction<SubstractOp>;
+using DivideFunction = FoldFunction<DivideOp>;
+using MaxFunction = FoldFunction<MaxOp>;
+using MinFunction = FoldFunction<MinOp>;
+
+// Chained comparison: true when Compare holds for every adjacent pair. For reflexive
+// comparisons a repeated fixnum object is skipped without unboxing; flonums are always compared,
+// since a NaN is not equal to itself. Pairs of fixnums compare directly, pairs with a flonum
+// through CompareReals, which is exact for mixed pairs.
+template <class Compare>
+class CompareFunction : public IFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::string Invoke(ArgSpan args) override {
+        std::string res;
+        InvokeTo(args, &res);
+        return res;
+    }
+
+    void InvokeTo(ArgSpan args, std::string* out) override {
+        bool res = true;
+        const Number* prev = nullptr;
+        if (!args.empty()) {
+            prev = dynamic_cast<const Number*>(args[0].get());
+            if (!prev) {
+                UnboxReal(args[0]);
+            }
+        }
+        for (size_t i = 1; i < args.size() && res; ++i) {
+            if constexpr (Compare{}(0, 0)) {
+                if (prev && args[i] == args[i - 1]) {
+                    continue;
+                }
+            }
+            auto cur = dynamic_cast<const Number*>(args[i].get());
+            if (prev && cur) {
+                res = Compare{}(prev->GetValue(), cur->GetValue());
+            } else {
+                auto order = CompareReals(args[i - 1], args[i]);
+                res = order != std::partial_ordering::unordered &&
+                      Compare{}(order < 0 ? -1 : order > 0 ? 1 : 0, 0);
+            }
+            prev = cur;
+        }
+        out->append(res ? "#t" : "#f");
+    }
 };
-class LEqFunction : public IFunction {
+
+using EqFunction = CompareFunction<std::equal_to<>>;
+using LFunction = CompareFunction<std::less<>>;
+using LEqFunction = CompareFunction<std::less_equal<>>;
+using GFunction = CompareFunction<std::greater<>>;
+using GEqFunction = CompareFunction<std::greater_equal<>>;
+
+class AbsFunction : public IFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::string Invoke(ArgSpan args) override;
 };
 
-class GFunction : public IFunction {
+// Placeholder for the quasiquote special form, which the interpreter evaluates itself.
+class QuasiquoteFunction : public IFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::string Invoke(ArgSpan args) override;
 };
-class GEqFunction : public IFunction {
+
+class NumberFunction : public IFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::string Invoke(ArgSpan args) override;
 };
 
 class BoolFunction : public IFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::string Invoke(ArgSpan args) override;
 };
 
 class NotFunction : public IFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::string Invoke(ArgSpan args) override;
 };
 
 class PairFunction : public IFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::string Invoke(ArgSpan args) override;
 };
 
 class ListFunction : public IFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::string Invoke(ArgSpan args) override;
 };
 
 class NullFunction : public IFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::string Invoke(ArgSpan args) override;
 };
 
 class AndFunction : public IFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::string Invoke(ArgSpan args) override;
 };
 
 class OrFunction : public IFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::string Invoke(ArgSpan args) override;
+};
+
+class MakeListFunction : public IObjectFunction {
+public:
+    void InvokeTo(ArgSpan args, std::string* out) override;
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+};
+
+class RefFunction : public IObjectFunction {
+public:
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+};
+
+class TailFunction : public IObjectFunction {
+public:
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+};
+
+class ConsFunction : public IObjectFunction {
+public:
+    void InvokeTo(ArgSpan args, std::string* out) override;
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+};
+
+class CarFunction : public IObjectFunction {
+public:
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+};
+
+class CdrFunction : public IObjectFunction {
+public:
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
 };
 
-class MakeListFunction : public IFunction {
+// Largest vector make-vector builds; the cap keeps the size times the per-item cost far from
+// overflow and turns absurd sizes into a RuntimeError instead of std::bad_alloc.
+constexpr int64_t kMaxVectorSize = int64_t{1} << 26;
+
+class MakeVectorFunction : public IObjectFunction {
+public:
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+};
+
+class VectorRefFunction : public IObjectFunction {
+public:
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+};
+
+class VectorSetFunction : public IObjectFunction {
+public:
+    // Sets the item in place when the call holds the only reference to the vector, as for a vector
+    // just built by another call; a vector that is also referenced elsewhere, such as a literal, is
+    // copied first.
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+};
+
+class VectorLengthFunction : public IFunction {
+public:
+    std::string Invoke(ArgSpan args) override;
+};
+
+class VectorMapFunction : public IObjectFunction {
+public:
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+    bool TakesProcedures() const override {
+        return true;
+    }
+};
+
+class VectorFoldFunction : public IObjectFunction {
+public:
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+    bool TakesProcedures() const override {
+        return true;
+    }
+};
+
+class MakeHashTableFunction : public IObjectFunction {
+public:
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+};
+
+class AlistToHashTableFunction : public IObjectFunction {
+public:
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+};
+
+class HashRefFunction : public IObjectFunction {
+public:
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+};
+
+class HashSetFunction : public IObjectFunction {
+public:
+    // Sets the entry in place when the call holds the only reference to the table, like
+    // vector-set!; a table also referenced elsewhere is copied first.
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+};
+
+class HashCountFunction : public IFunction {
+public:
+    std::string Invoke(ArgSpan args) override;
+};
+
+class StringAppendFunction : public IFunction {
+public:
+    std::string Invoke(ArgSpan args) override;
+};
+
+class SubstringFunction : public IFunction {
+public:
+    std::string Invoke(ArgSpan args) override;
+};
+
+class MapFunction : public IObjectFunction {
+public:
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+    bool TakesProcedures() const override {
+        return true;
+    }
+};
+
+class FilterFunction : public IObjectFunction {
+public:
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+    bool TakesProcedures() const override {
+        return true;
+    }
+};
+
+class FoldLeftFunction : public IObjectFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+    bool TakesProcedures() const override {
+        return true;
+    }
 };
 
-class RefFunction : public IFunction {
+class FoldRightFunction : public IObjectFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+    bool TakesProcedures() const override {
+        return true;
+    }
 };
 
-class TailFunction : public IFunction {
+class ApplyFunction : public IObjectFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    void InvokeTo(ArgSpan args, std::string* out) override;
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+    bool TakesProcedures() const override {
+        return true;
+    }
 };
 
-class ConsFunction : public IFunction {
+class LengthFunction : public IFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::string Invoke(ArgSpan args) override;
 };
 
-class CarFunction : public IFunction {
+class AppendFunction : public IObjectFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
 };
 
-class CdrFunction : public IFunction {
+class ReverseFunction : public IObjectFunction {
 public:
-    std::string Invoke(const std::vector<std::shared_ptr<Object>>& args) override;
+    std::shared_ptr<Object> InvokeValue(ArgSpan args) override;
+};
+
+template <size_t N>
+struct FixedString {
+    char value[N];
+
+    constexpr FixedString(const char (&str)[N]) {
+        std::copy_n(str, N, value);
+    }
+};
+
+template <class T>
+struct ArgTraits;
+
+template <>
+struct ArgTraits<int64_t> {
+    static int64_t Unbox(const std::shared_ptr<Object>& arg) {
+        return UnboxNumber(arg);
+    }
+
+    static void Box(int64_t value, std::string* out) {
+        AppendNumber(value, out);
+    }
+};
+
+template <>
+struct ArgTraits<bool> {
+    static bool Unbox(const std::shared_ptr<Object>& arg) {
+        auto value = dynamic_cast<const Bool*>(arg.get());
+        if (!value) {
+            throw RuntimeError();
+        }
+        return value->GetBool();
+    }
+
+    static void Box(bool value, std::string* out) {
+        out->append(value ? "#t" : "#f");
+    }
+};
+
+template <>
+struct ArgTraits<std::string> {
+    static const std::string& Unbox(const std::shared_ptr<Object>& arg) {
+        auto value = dynamic_cast<const String*>(arg.get());
+        if (!value) {
+            throw RuntimeError();
+        }
+        return value->GetValue();
+    }
+
+    static void Box(const std::string& value, std::string* out) {
+        String(value).Print(out);
+    }
 };
+
+template <>
+struct ArgTraits<std::shared_ptr<Object>> {
+    static const std::shared_ptr<Object>& Unbox(const std::shared_ptr<Object>& arg) {
+        if (!arg) {
+            throw RuntimeError();
+        }
+        return arg;
+    }
+
+    static void Box(const std::shared_ptr<Object>& value, std::string* out) {
+        if (!value) {
+            throw RuntimeError();
+        }
+        value->Print(out);
+    }
+};
+
+template <class F>
+struct Signature : Signature<decltype(&F::operator())> {};
+
+template <class R, class... A>
+struct Signature<R (*)(A...)> {
+    using Result = std::decay_t<R>;
+    using Args = std::tuple<std::decay_t<A>...>;
+};
+
+template <class C, class R, class... A>
+struct Signature<R (C::*)(A...)> : Signature<R (*)(A...)> {};
+
+template <class C, class R, class... A>
+struct Signature<R (C::*)(A...) const> : Signature<R (*)(A...)> {};
+
+// Adapts a plain C++ callable to IFunction. Arity and argument types come from the callable's
+// signature: int64_t, bool, std::string and std::shared_ptr<Object> parameters are checked and
+// unboxed, and a trailing ArgSpan parameter takes the remaining arguments.
+template <class F>
+class NativeFunction : public IFunction {
+    using Args = typename Signature<F>::Args;
+    using Result = typename Signature<F>::Result;
+    static constexpr size_t kArity = std::tuple_size_v<Args>;
+    static constexpr bool kVariadic = [] {
+        if constexpr (kArity == 0) {
+            return false;
+        } else {
+            return std::is_same_v<std::tuple_element_t<kArity - 1, Args>, ArgSpan>;
+        }
+    }();
+
+public:
+    explicit NativeFunction(F func) : func_(std::move(func)) {
+    }
+
+    std::string Invoke(ArgSpan args) override {
+        std::string res;
+        InvokeTo(args, &res);
+        return res;
+    }
+
+    void InvokeTo(ArgSpan args, std::string* out) override {
+        if (kVariadic ? args.size() < kArity - 1 : args.size() != kArity) {
+            throw RuntimeError();
+        }
+        Call(args, out, std::make_index_sequence<kArity>{});
+    }
+
+private:
+    template <size_t I>
+    decltype(auto) Unbox(ArgSpan args) {
+        if constexpr (kVariadic && I == kArity - 1) {
+            return args.subspan(I);
+        } else {
+            return ArgTraits<std::tuple_element_t<I, Args>>::Unbox(args[I]);
+        }
+    }
+
+    template <size_t... I>
+    void Call(ArgSpan args, std::string* out, std::index_sequence<I...>) {
+        ArgTraits<Result>::Box(func_(Unbox<I>(args)...), out);
+    }
+
+    F func_;
+};
+
+template <class F>
+std::shared_ptr<IFunction> MakeFunction(F func) {
+    return std::make_shared<NativeFunction<F>>(std::move(func));
+}
@@ -0,0 +1,82 @@
+#include "hashcons.h"
+
+#include <bit>
+#include <functional>
+
+static size_t Combine(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+size_t HashConsTable::PairHash::operator()(const std::pair<Object*, Object*>& key) const {
+    std::hash<Object*> hash;
+    return Combine(hash(key.first), hash(key.second));
+}
+
+size_t HashConsTable::ItemsHash::operator()(const std::vector<Object*>& key) const {
+    std::hash<Object*> hash;
+    size_t res = key.size();
+    for (auto item : key) {
+        res = Combine(res, hash(item));
+    }
+    return res;
+}
+
+template <class Map, class Key>
+std::shared_ptr<Object> HashConsTable::Lookup(Map* map, Key&& key, std::shared_ptr<Object> obj,
+                                              size_t size) {
+    ++stats_.nodes;
+    auto [it, inserted] = map->try_emplace(std::forward<Key>(key), obj);
+    if (inserted) {
+        ++stats_.unique;
+    } else {
+        stats_.bytes_saved += size;
+    }
+    return it->second;
+}
+
+std::shared_ptr<Object> HashConsTable::Intern(std::shared_ptr<Object> obj) {
+    if (!obj) {
+        return obj;
+    }
+    if (Is<Number>(obj)) {
+        return Lookup(&numbers_, As<Number>(obj)->GetValue(), obj, sizeof(Number));
+    }
+    if (Is<Flonum>(obj)) {
+        // Keyed by bit pattern, so 0.0 and -0.0 stay apart and equal NaNs share a node.
+        auto bits = std::bit_cast<uint64_t>(As<Flonum>(obj)->GetValue());
+        return Lookup(&flonums_, bits, obj, sizeof(Flonum));
+    }
+    if (Is<Symbol>(obj)) {
+        auto& name = As<Symbol>(obj)->GetName();
+        return Lookup(&symbols_, name, obj, sizeof(Symbol) + name.capacity());
+    }
+    if (Is<String>(obj)) {
+        auto& value = As<String>(obj)->GetValue();
+        return Lookup(&strings_, value, obj, sizeof(String) + value.capacity());
+    }
+    if (Is<Cell>(obj)) {
+        auto cell = As<Cell>(obj);
+        std::pair<Object*, Object*> key{cell->GetFirst().get(), cell->GetSecond().get()};
+        return Lookup(&cells_, key, obj, sizeof(Cell));
+    }
+    if (Is<Vector>(obj)) {
+        std::vector<Object*> key;
+        for (auto& item : As<Vector>(obj)->GetItems()) {
+            key.push_back(item.get());
+        }
+        size_t size = sizeof(Vector) + key.size() * sizeof(std::shared_ptr<Object>);
+        return Lookup(&vectors_, std::move(key), obj, size);
+    }
+    if (Is<Bool>(obj)) {
+        ++stats_.nodes;
+        auto& slot = bools_[As<Bool>(obj)->GetBool()];
+        if (slot) {
+            stats_.bytes_saved += sizeof(Bool);
+        } else {
+            ++stats_.unique;
+            slot = obj;
+        }
+        return slot;
+    }
+    return obj;
+}
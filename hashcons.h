@@ -0,0 +1,58 @@
+#pragma once
+
+#include "object.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct HashConsStats {
+    size_t nodes = 0;
+    size_t unique = 0;
+    size_t bytes_saved = 0;
+
+    double DedupRatio() const {
+        return unique ? static_cast<double>(nodes) / unique : 1.0;
+    }
+
+    HashConsStats& operator+=(const HashConsStats& other) {
+        nodes += other.nodes;
+        unique += other.unique;
+        bytes_saved += other.bytes_saved;
+        return *this;
+    }
+};
+
+class HashConsTable {
+public:
+    std::shared_ptr<Object> Intern(std::shared_ptr<Object> obj);
+
+    const HashConsStats& GetStats() const {
+        return stats_;
+    }
+
+private:
+    struct PairHash {
+        size_t operator()(const std::pair<Object*, Object*>& key) const;
+    };
+
+    struct ItemsHash {
+        size_t operator()(const std::vector<Object*>& key) const;
+    };
+
+    template <class Map, class Key>
+    std::shared_ptr<Object> Lookup(Map* map, Key&& key, std::shared_ptr<Object> obj, size_t size);
+
+    std::unordered_map<int64_t, std::shared_ptr<Object>> numbers_;
+    std::unordered_map<uint64_t, std::shared_ptr<Object>> flonums_;
+    std::unordered_map<std::string, std::shared_ptr<Object>> symbols_;
+    std::unordered_map<std::string, std::shared_ptr<Object>> strings_;
+    std::unordered_map<std::pair<Object*, Object*>, std::shared_ptr<Object>, PairHash> cells_;
+    std::unordered_map<std::vector<Object*>, std::shared_ptr<Object>, ItemsHash> vectors_;
+    std::shared_ptr<Object> bools_[2];
+    HashConsStats stats_;
+};
@@ -0,0 +1,154 @@
+#include "hashtable.h"
+#include "error.h"
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+
+namespace {
+
+enum KeyTag : uint32_t { kNoKey, kFixnumKey, kSymbolKey };
+
+constexpr size_t kMinCapacity = 8;
+
+uint64_t Mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Reduces a key to its slot representation; name is set for symbol keys.
+void EncodeKey(const Object* key, int64_t* bits, uint32_t* tag, const std::string** name) {
+    if (auto number = dynamic_cast<const Number*>(key)) {
+        *bits = number->GetValue();
+        *tag = kFixnumKey;
+        *name = nullptr;
+        return;
+    }
+    auto symbol = dynamic_cast<const Symbol*>(key);
+    if (!symbol) {
+        throw RuntimeError();
+    }
+    *name = &symbol->GetName();
+    *bits = static_cast<int64_t>(std::hash<std::string>{}(**name));
+    *tag = kSymbolKey;
+}
+
+size_t Start(int64_t bits, uint32_t tag, size_t mask) {
+    return Mix(static_cast<uint64_t>(bits) + tag * 0x9e3779b97f4a7c15ULL) & mask;
+}
+
+}  // namespace
+
+HashTable::HashTable() {
+    bytes_ = Bytes();
+    CountAllocation(ObjectType::kHashTable, bytes_, this);
+}
+
+HashTable::HashTable(const HashTable& other)
+    : Object(), slots_(other.slots_), entries_(other.entries_) {
+    entries_.reserve(other.entries_.capacity());
+    bytes_ = Bytes();
+    CountAllocation(ObjectType::kHashTable, bytes_, this);
+}
+
+HashTable::~HashTable() {
+    CountRelease(ObjectType::kHashTable, bytes_, this);
+}
+
+size_t HashTable::Probe(int64_t key, uint32_t tag, const std::string* name) const {
+    size_t mask = slots_.size() - 1;
+    for (size_t i = Start(key, tag, mask);; i = (i + 1) & mask) {
+        auto& slot = slots_[i];
+        if (slot.tag == kNoKey) {
+            return i;
+        }
+        if (slot.key != key || slot.tag != tag) {
+            continue;
+        }
+        if (!name ||
+            static_cast<const Symbol*>(entries_[slot.entry].key.get())->GetName() == *name) {
+            return i;
+        }
+    }
+}
+
+const std::shared_ptr<Object>* HashTable::Find(const std::shared_ptr<Object>& key) const {
+    int64_t bits;
+    uint32_t tag;
+    const std::string* name;
+    EncodeKey(key.get(), &bits, &tag, &name);
+    if (slots_.empty()) {
+        return nullptr;
+    }
+    auto& slot = slots_[Probe(bits, tag, name)];
+    return slot.tag == kNoKey ? nullptr : &entries_[slot.entry].value;
+}
+
+void HashTable::Set(std::shared_ptr<Object> key, std::shared_ptr<Object> value) {
+    int64_t bits;
+    uint32_t tag;
+    const std::string* name;
+    EncodeKey(key.get(), &bits, &tag, &name);
+    Reserve(entries_.size() + 1);
+    auto& slot = slots_[Probe(bits, tag, name)];
+    if (slot.tag != kNoKey) {
+        entries_[slot.entry].value = std::move(value);
+        return;
+    }
+    slot = {bits, static_cast<uint32_t>(entries_.size()), tag};
+    entries_.push_back({std::move(key), std::move(value)});
+}
+
+void HashTable::Reserve(size_t size) {
+    // Keeps the load factor at or below 3/4.
+    if (size * 4 <= slots_.size() * 3) {
+        return;
+    }
+    Rehash(std::bit_ceil(std::max(kMinCapacity, (size * 4 + 2) / 3)));
+}
+
+void HashTable::Rehash(size_t capacity) {
+    slots_.assign(capacity, Slot{0, 0, kNoKey});
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        int64_t bits;
+        uint32_t tag;
+        const std::string* name;
+        EncodeKey(entries_[i].key.get(), &bits, &tag, &name);
+        // Keys are distinct, so each entry takes the first free slot of its probe sequence.
+        size_t j = Start(bits, tag, mask);
+        while (slots_[j].tag != kNoKey) {
+            j = (j + 1) & mask;
+        }
+        slots_[j] = {bits, static_cast<uint32_t>(i), tag};
+    }
+    // Entries never reallocate between two rehashes, so the accounted size stays exact.
+    entries_.reserve(capacity / 4 * 3);
+    CountRelease(ObjectType::kHashTable, bytes_, this);
+    bytes_ = Bytes();
+    CountAllocation(ObjectType::kHashTable, bytes_, this);
+}
+
+size_t HashTable::Bytes() const {
+    return sizeof(HashTable) + slots_.capacity() * sizeof(Slot) +
+           entries_.capacity() * sizeof(HashEntry);
+}
+
+void HashTable::Print(std::string* out) const {
+    out->append("#hash(");
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        if (i > 0) {
+            out->push_back(' ');
+        }
+        out->push_back('(');
+        entries_[i].key->Print(out);
+        out->append(" . ");
+        PrintDatum(entries_[i].value.get(), out);
+        out->push_back(')');
+    }
+    out->push_back(')');
+}
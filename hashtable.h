@@ -0,0 +1,58 @@
+#pragma once
+
+#include "object.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct HashEntry {
+    std::shared_ptr<Object> key;
+    std::shared_ptr<Object> value;
+};
+
+// Table keyed by fixnums and symbols. A slot holds the fixnum itself or the hash of the symbol
+// name, which is compared with the entry's name only when the hashes agree. Entries keep
+// insertion order; the index is an open-addressing array of 16-byte slots probed linearly.
+class HashTable : public Object {
+public:
+    HashTable();
+    HashTable(const HashTable& other);
+    ~HashTable() override;
+
+    size_t Size() const {
+        return entries_.size();
+    }
+
+    const std::vector<HashEntry>& GetEntries() const {
+        return entries_;
+    }
+
+    // Value stored under key, or nullptr when the key is absent; throws RuntimeError for keys other
+    // than numbers and symbols.
+    const std::shared_ptr<Object>* Find(const std::shared_ptr<Object>& key) const;
+
+    // Inserts or replaces; throws RuntimeError for keys other than numbers and symbols.
+    void Set(std::shared_ptr<Object> key, std::shared_ptr<Object> value);
+
+    void Reserve(size_t size);
+
+    void Print(std::string* out) const override;
+
+private:
+    struct Slot {
+        int64_t key;
+        uint32_t entry;
+        uint32_t tag;
+    };
+
+    size_t Probe(int64_t key, uint32_t tag, const std::string* name) const;
+    void Rehash(size_t capacity);
+    size_t Bytes() const;
+
+    std::vector<Slot> slots_;
+    std::vector<HashEntry> entries_;
+    size_t bytes_ = 0;
+};
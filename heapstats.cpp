@@ -0,0 +1,306 @@
+#include "heapstats.h"
+
+#ifdef SCHEME_HEAP_STATS
+
+#include "hashtable.h"
+#include "object.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+constexpr size_t kTypes = static_cast<size_t>(ObjectType::kCount);
+constexpr size_t kPreviewSize = 64;
+constexpr const char* kTypeNames[kTypes] = {"number", "flonum", "bool",      "symbol",    "string",
+                                            "cell",   "vector", "procedure", "hash-table"};
+
+struct Counter {
+    std::atomic<int64_t> value = 0;
+
+    // Only the owning thread writes, so a plain load and store is enough; readers may see a
+    // slightly stale value.
+    int64_t Add(int64_t delta) {
+        int64_t res = value.load(std::memory_order_relaxed) + delta;
+        value.store(res, std::memory_order_relaxed);
+        return res;
+    }
+
+    int64_t Get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+struct TypeCounters {
+    Counter live, live_bytes, peak, peak_bytes, allocated, allocated_bytes;
+};
+
+struct HeapCounters {
+    std::array<TypeCounters, kTypes> types;
+
+    void Merge(const HeapCounters& other) {
+        for (size_t i = 0; i < kTypes; ++i) {
+            auto& to = types[i];
+            auto& from = other.types[i];
+            to.live.Add(from.live.Get());
+            to.live_bytes.Add(from.live_bytes.Get());
+            to.peak.Add(from.peak.Get());
+            to.peak_bytes.Add(from.peak_bytes.Get());
+            to.allocated.Add(from.allocated.Get());
+            to.allocated_bytes.Add(from.allocated_bytes.Get());
+        }
+    }
+};
+
+struct LargeObject {
+    const char* type;
+    size_t bytes;
+    std::string preview;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::unordered_set<HeapCounters*> threads;
+    HeapCounters retired;
+    std::unordered_map<const Object*, LargeObject> large;
+};
+
+Registry& GetRegistry() {
+    static auto* registry = new Registry();
+    return *registry;
+}
+
+struct ThreadCounters {
+    HeapCounters counters;
+
+    ThreadCounters() {
+        auto& registry = GetRegistry();
+        std::lock_guard lock(registry.mutex);
+        registry.threads.insert(&counters);
+    }
+
+    ~ThreadCounters() {
+        auto& registry = GetRegistry();
+        std::lock_guard lock(registry.mutex);
+        registry.threads.erase(&counters);
+        registry.retired.Merge(counters);
+    }
+};
+
+HeapCounters& Local() {
+    static thread_local ThreadCounters counters;
+    return counters.counters;
+}
+
+void AppendEscaped(const std::string& str, std::string* out) {
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out->push_back('\\');
+            out->push_back(c);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out->push_back(' ');
+        } else {
+            out->push_back(c);
+        }
+    }
+}
+
+// Appends an element of a previewed container: atoms in full, nested containers elided.
+void AppendElement(const Object* obj, std::string* out) {
+    if (!obj) {
+        out->append("()");
+    } else if (dynamic_cast<const Cell*>(obj)) {
+        out->append("(...)");
+    } else if (dynamic_cast<const Vector*>(obj)) {
+        out->append("#(...)");
+    } else if (dynamic_cast<const HashTable*>(obj)) {
+        out->append("#hash(...)");
+    } else {
+        obj->Print(out);
+    }
+}
+
+// The first kPreviewSize characters of obj, printed one level deep. Elements stop once the
+// preview is full, so a preview costs the same for any size of list, vector or table.
+std::string Preview(const Object* obj) {
+    std::string res;
+    auto full = [&res] { return res.size() >= kPreviewSize; };
+    if (dynamic_cast<const Cell*>(obj)) {
+        res.push_back('(');
+        auto cur = obj;
+        while (auto cell = dynamic_cast<const Cell*>(cur)) {
+            if (full()) {
+                break;
+            }
+            if (cur != obj) {
+                res.push_back(' ');
+            }
+            AppendElement(cell->GetFirst().get(), &res);
+            cur = cell->GetSecond().get();
+        }
+        if (cur && !full() && !dynamic_cast<const Cell*>(cur)) {
+            res.append(" . ");
+            AppendElement(cur, &res);
+        }
+        res.push_back(')');
+    } else if (auto vector = dynamic_cast<const Vector*>(obj)) {
+        res.append("#(");
+        for (size_t i = 0; i < vector->Size() && !full(); ++i) {
+            if (i > 0) {
+                res.push_back(' ');
+            }
+            AppendElement(vector->Get(i).get(), &res);
+        }
+        res.push_back(')');
+    } else if (auto table = dynamic_cast<const HashTable*>(obj)) {
+        res.append("#hash(");
+        auto& entries = table->GetEntries();
+        for (size_t i = 0; i < entries.size() && !full(); ++i) {
+            if (i > 0) {
+                res.push_back(' ');
+            }
+            res.push_back('(');
+            AppendElement(entries[i].key.get(), &res);
+            res.append(" . ");
+            AppendElement(entries[i].value.get(), &res);
+            res.push_back(')');
+        }
+        res.push_back(')');
+    } else {
+        obj->Print(&res);
+    }
+    if (res.size() > kPreviewSize) {
+        res.resize(kPreviewSize);
+        res.append("...");
+    }
+    return res;
+}
+
+void Register(const Object* obj, const char* type, size_t bytes) {
+    auto preview = Preview(obj);
+    auto& registry = GetRegistry();
+    std::lock_guard lock(registry.mutex);
+    registry.large.insert_or_assign(obj, LargeObject{type, bytes, std::move(preview)});
+}
+
+void Unregister(const Object* obj) {
+    auto& registry = GetRegistry();
+    std::lock_guard lock(registry.mutex);
+    registry.large.erase(obj);
+}
+
+}  // namespace
+
+void CountAllocation(ObjectType type, size_t bytes, const Object* obj) {
+    auto& counters = Local().types[static_cast<size_t>(type)];
+    int64_t live = counters.live.Add(1);
+    int64_t live_bytes = counters.live_bytes.Add(bytes);
+    if (live > counters.peak.Get()) {
+        counters.peak.value.store(live, std::memory_order_relaxed);
+    }
+    if (live_bytes > counters.peak_bytes.Get()) {
+        counters.peak_bytes.value.store(live_bytes, std::memory_order_relaxed);
+    }
+    counters.allocated.Add(1);
+    counters.allocated_bytes.Add(bytes);
+    if (bytes >= kLargeObjectBytes) {
+        Register(obj, kTypeNames[static_cast<size_t>(type)], bytes);
+    }
+}
+
+void CountRelease(ObjectType type, size_t bytes, const Object* obj) {
+    auto& counters = Local().types[static_cast<size_t>(type)];
+    counters.live.Add(-1);
+    counters.live_bytes.Add(-static_cast<int64_t>(bytes));
+    if (bytes >= kLargeObjectBytes) {
+        Unregister(obj);
+    }
+}
+
+bool CountStructure(size_t bytes, const Object* head) {
+    if (bytes < kLargeObjectBytes) {
+        return false;
+    }
+    Register(head, "list", bytes);
+    return true;
+}
+
+void ReleaseStructure(const Object* head) {
+    Unregister(head);
+}
+
+AllocationTotals ThreadAllocations() {
+    AllocationTotals res;
+    for (auto& counters : Local().types) {
+        res.objects += counters.allocated.Get();
+        res.bytes += counters.allocated_bytes.Get();
+    }
+    return res;
+}
+
+std::string DumpHeapStats(size_t largest) {
+    auto& registry = GetRegistry();
+    std::lock_guard lock(registry.mutex);
+    HeapCounters total;
+    total.Merge(registry.retired);
+    for (auto counters : registry.threads) {
+        total.Merge(*counters);
+    }
+
+    std::string out = "{\"enabled\":true,\"types\":{";
+    TypeCounters sum;
+    for (size_t i = 0; i < kTypes; ++i) {
+        auto& counters = total.types[i];
+        if (i > 0) {
+            out.push_back(',');
+        }
+        out.append("\"").append(kTypeNames[i]).append("\":{");
+        auto field = [&out](const char* name, const Counter& counter, bool last = false) {
+            out.append("\"").append(name).append("\":");
+            AppendNumber(counter.Get(), &out);
+            if (!last) {
+                out.push_back(',');
+            }
+        };
+        field("live", counters.live);
+        field("live_bytes", counters.live_bytes);
+        field("peak", counters.peak);
+        field("peak_bytes", counters.peak_bytes);
+        field("allocated", counters.allocated);
+        field("allocated_bytes", counters.allocated_bytes, true);
+        out.push_back('}');
+        sum.live.Add(counters.live.Get());
+        sum.live_bytes.Add(counters.live_bytes.Get());
+    }
+    out.append("},\"live\":");
+    AppendNumber(sum.live.Get(), &out);
+    out.append(",\"live_bytes\":");
+    AppendNumber(sum.live_bytes.Get(), &out);
+
+    std::vector<const LargeObject*> large;
+    for (auto& entry : registry.large) {
+        large.push_back(&entry.second);
+    }
+    size_t count = std::min(largest, large.size());
+    std::partial_sort(large.begin(), large.begin() + count, large.end(),
+                      [](auto a, auto b) { return a->bytes > b->bytes; });
+    out.append(",\"largest\":[");
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0) {
+            out.push_back(',');
+        }
+        out.append("{\"type\":\"").append(large[i]->type).append("\",\"bytes\":");
+        AppendNumber(large[i]->bytes, &out);
+        out.append(",\"preview\":\"");
+        AppendEscaped(large[i]->preview, &out);
+        out.append("\"}");
+    }
+    out.append("]}");
+    return out;
+}
+
+#endif
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class Object;
+
+enum class ObjectType {
+    kNumber,
+    kFlonum,
+    kBool,
+    kSymbol,
+    kString,
+    kCell,
+    kVector,
+    kProcedure,
+    kHashTable,
+    kCount
+};
+
+struct AllocationTotals {
+    size_t objects = 0;
+    size_t bytes = 0;
+};
+
+// Payload a std::string keeps outside the object, zero while it fits the small buffer.
+inline size_t HeapBytes(const std::string& str) {
+    return str.capacity() > std::string().capacity() ? str.capacity() + 1 : 0;
+}
+
+#ifdef SCHEME_HEAP_STATS
+
+// Objects at least this large are listed individually in the dump.
+constexpr size_t kLargeObjectBytes = 4096;
+
+void CountAllocation(ObjectType type, size_t bytes, const Object* obj);
+
+void CountRelease(ObjectType type, size_t bytes, const Object* obj);
+
+// Lists the list headed by head in the dump, with the bytes of all its cells, once those reach
+// kLargeObjectBytes. Returns whether it did; ReleaseStructure must then run before head dies.
+bool CountStructure(size_t bytes, const Object* head);
+
+void ReleaseStructure(const Object* head);
+
+// Objects and bytes allocated so far by the calling thread.
+AllocationTotals ThreadAllocations();
+
+// Live and peak counts per type plus the largest live objects and lists, as a JSON object. Counters
+// are kept per thread and summed here; a peak is the sum of per-thread peaks, so it is exact for
+// objects that stay on the thread that created them and an upper bound otherwise. Bytes cover
+// the object and its out-of-line payload, not shared_ptr control blocks or allocator slack. The
+// preview of a large object is taken on its own thread when it is counted, so the dump never
+// reads objects other threads may be changing.
+std::string DumpHeapStats(size_t largest = 10);
+
+#else
+
+inline void CountAllocation(ObjectType, size_t, const Object*) {
+}
+
+inline void CountRelease(ObjectType, size_t, const Object*) {
+}
+
+inline AllocationTotals ThreadAllocations() {
+    return {};
+}
+
+inline std::string DumpHeapStats(size_t = 10) {
+    return "{\"enabled\":false}";
+}
+
+#endif
@@ -0,0 +1,283 @@
+#include "image.h"
+#include "error.h"
+#include "hashtable.h"
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+class ImageWriter {
+public:
+    void WriteObject(const std::shared_ptr<Object>& obj, size_t depth = 0) {
+        if (depth > kMaxImageDepth) {
+            throw RuntimeError();
+        }
+        if (!obj) {
+            PutTag(ImageTag::kNull);
+        } else if (Is<Number>(obj)) {
+            PutTag(ImageTag::kNumber);
+            Put<int64_t>(&body_, As<Number>(obj)->GetValue());
+        } else if (Is<Flonum>(obj)) {
+            PutTag(ImageTag::kFlonum);
+            Put<double>(&body_, As<Flonum>(obj)->GetValue());
+        } else if (Is<Bool>(obj)) {
+            PutTag(As<Bool>(obj)->GetBool() ? ImageTag::kTrue : ImageTag::kFalse);
+        } else if (Is<Symbol>(obj)) {
+            PutTag(ImageTag::kSymbol);
+            Put<uint32_t>(&body_, Intern(As<Symbol>(obj)->GetName()));
+        } else if (Is<String>(obj)) {
+            auto& value = As<String>(obj)->GetValue();
+            PutTag(ImageTag::kString);
+            Put<uint32_t>(&body_, value.size());
+            body_ += value;
+        } else if (Is<Vector>(obj)) {
+            auto& items = As<Vector>(obj)->GetItems();
+            PutTag(ImageTag::kVector);
+            Put<uint32_t>(&body_, items.size());
+            for (auto& item : items) {
+                WriteObject(item, depth + 1);
+            }
+        } else if (Is<HashTable>(obj)) {
+            auto& entries = As<HashTable>(obj)->GetEntries();
+            PutTag(ImageTag::kHashTable);
+            Put<uint32_t>(&body_, entries.size());
+            for (auto& entry : entries) {
+                WriteObject(entry.key, depth + 1);
+                WriteObject(entry.value, depth + 1);
+            }
+        } else {
+            std::vector<const Cell*> cells;
+            const Object* cur = obj.get();
+            while (auto cell = dynamic_cast<const Cell*>(cur)) {
+                cells.push_back(cell);
+                cur = cell->GetSecond().get();
+            }
+            PutTag(ImageTag::kList);
+            Put<uint32_t>(&body_, cells.size());
+            for (auto cell : cells) {
+                WriteObject(cell->GetFirst(), depth + 1);
+            }
+            WriteObject(cells.back()->GetSecond(), depth + 1);
+        }
+    }
+
+    std::string Finish(uint32_t roots) {
+        std::string res(kImageMagic, sizeof(kImageMagic));
+        Put<uint32_t>(&res, kImageVersion);
+        Put<uint32_t>(&res, names_.size());
+        for (auto& name : names_) {
+            Put<uint32_t>(&res, name.size());
+            res += name;
+        }
+        Put<uint32_t>(&res, roots);
+        return res + body_;
+    }
+
+private:
+    void PutTag(ImageTag tag) {
+        body_.push_back(static_cast<char>(tag));
+    }
+
+    template <class T>
+    static void Put(std::string* out, T value) {
+        out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    uint32_t Intern(const std::string& name) {
+        auto [it, inserted] = ids_.emplace(name, names_.size());
+        if (inserted) {
+            names_.push_back(name);
+        }
+        return it->second;
+    }
+
+    std::unordered_map<std::string, uint32_t> ids_;
+    std::vector<std::string> names_;
+    std::string body_;
+};
+
+class ImageReader {
+public:
+    ImageReader(const char* data, size_t size) : cur_(data), end_(data + size) {
+    }
+
+    std::vector<std::shared_ptr<Object>> ReadAll() {
+        if (static_cast<size_t>(end_ - cur_) < sizeof(kImageMagic) ||
+            std::memcmp(cur_, kImageMagic, sizeof(kImageMagic)) != 0) {
+            throw SyntaxError();
+        }
+        cur_ += sizeof(kImageMagic);
+        if (Get<uint32_t>() != kImageVersion) {
+            throw SyntaxError();
+        }
+        // Each name takes at least its length prefix.
+        uint32_t count = GetCount(sizeof(uint32_t));
+        symbols_.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t size = Get<uint32_t>();
+            Need(size);
+            symbols_.push_back(std::make_shared<Symbol>(std::string(cur_, size)));
+            cur_ += size;
+        }
+        std::vector<std::shared_ptr<Object>> res(GetCount(1));
+        for (auto& obj : res) {
+            obj = ReadObject();
+        }
+        if (cur_ != end_) {
+            throw SyntaxError();
+        }
+        return res;
+    }
+
+private:
+    void Need(size_t size) {
+        if (static_cast<size_t>(end_ - cur_) < size) {
+            throw SyntaxError();
+        }
+    }
+
+    // Reads a record count, rejecting one the rest of the image is too short to hold given the
+    // smallest encoding of a record, so a corrupt count cannot drive an allocation.
+    uint32_t GetCount(size_t min_record) {
+        uint32_t count = Get<uint32_t>();
+        if (count > static_cast<size_t>(end_ - cur_) / min_record) {
+            throw SyntaxError();
+        }
+        return count;
+    }
+
+    template <class T>
+    T Get() {
+        Need(sizeof(T));
+        T value;
+        std::memcpy(&value, cur_, sizeof(T));
+        cur_ += sizeof(T);
+        return value;
+    }
+
+    std::shared_ptr<Object> ReadObject(size_t depth = 0) {
+        if (depth > kMaxImageDepth) {
+            throw SyntaxError();
+        }
+        switch (static_cast<ImageTag>(Get<uint8_t>())) {
+            case ImageTag::kNull:
+                return nullptr;
+            case ImageTag::kNumber:
+                return std::make_shared<Number>(Get<int64_t>());
+            case ImageTag::kFlonum:
+                return std::make_shared<Flonum>(Get<double>());
+            case ImageTag::kFalse:
+                return std::make_shared<Bool>(false);
+            case ImageTag::kTrue:
+                return std::make_shared<Bool>(true);
+            case ImageTag::kSymbol: {
+                uint32_t id = Get<uint32_t>();
+                if (id >= symbols_.size()) {
+                    throw SyntaxError();
+                }
+                return symbols_[id];
+            }
+            case ImageTag::kString: {
+                uint32_t size = Get<uint32_t>();
+                Need(size);
+                auto res = std::make_shared<String>(std::string(cur_, size));
+                cur_ += size;
+                return res;
+            }
+            case ImageTag::kVector: {
+                std::vector<std::shared_ptr<Object>> items(GetCount(1));
+                for (auto& item : items) {
+                    item = ReadObject(depth + 1);
+                }
+                return std::make_shared<Vector>(std::move(items));
+            }
+            case ImageTag::kHashTable: {
+                uint32_t size = GetCount(2);
+                auto res = std::make_shared<HashTable>();
+                for (uint32_t i = 0; i < size; ++i) {
+                    auto key = ReadObject(depth + 1);
+                    if (!Is<Number>(key) && !Is<Symbol>(key)) {
+                        throw SyntaxError();
+                    }
+                    res->Set(std::move(key), ReadObject(depth + 1));
+                }
+                return res;
+            }
+            case ImageTag::kList: {
+                uint32_t size = GetCount(1);
+                if (size == 0) {
+                    throw SyntaxError();
+                }
+                std::vector<std::shared_ptr<Object>> items;
+                items.reserve(size);
+                for (uint32_t i = 0; i < size; ++i) {
+                    items.push_back(ReadObject(depth + 1));
+                }
+                auto res = std::make_shared<Cell>(items.back(), ReadObject(depth + 1));
+                for (size_t i = items.size() - 1; i > 0; --i) {
+                    res = std::make_shared<Cell>(items[i - 1], std::move(res));
+                }
+                res->CountList(size);
+                return res;
+            }
+        }
+        throw SyntaxError();
+    }
+
+    const char* cur_;
+    const char* end_;
+    std::vector<std::shared_ptr<Symbol>> symbols_;
+};
+
+}  // namespace
+
+std::string WriteImage(const std::vector<std::shared_ptr<Object>>& objects) {
+    ImageWriter writer;
+    for (auto& obj : objects) {
+        writer.WriteObject(obj);
+    }
+    return writer.Finish(objects.size());
+}
+
+std::vector<std::shared_ptr<Object>> ReadImage(const char* data, size_t size) {
+    return ImageReader(data, size).ReadAll();
+}
+
+std::vector<std::shared_ptr<Object>> LoadImage(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), path);
+    }
+    size_t size = st.st_size;
+    if (size == 0) {
+        close(fd);
+        throw SyntaxError();
+    }
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    try {
+        auto res = ReadImage(static_cast<const char*>(data), size);
+        munmap(data, size);
+        return res;
+    } catch (...) {
+        munmap(data, size);
+        throw;
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "object.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+constexpr uint32_t kImageVersion = 1;
+
+// Header layout: four magic bytes, the version, the symbol count and its names, then the root
+// count. Every count in the image is a little-endian uint32_t.
+constexpr char kImageMagic[4] = {'S', 'C', 'M', 'I'};
+constexpr size_t kImageSymbolCountOffset = sizeof(kImageMagic) + sizeof(uint32_t);
+
+// Each object in the body starts with one of these bytes.
+enum class ImageTag : uint8_t {
+    kNull,
+    kNumber,
+    kFalse,
+    kTrue,
+    kSymbol,
+    kList,
+    kString,
+    kVector,
+    kHashTable,
+    kFlonum
+};
+
+// Deepest nesting of vectors, tables and list elements WriteImage and ReadImage accept, so a
+// hostile or runaway structure fails with an error rather than exhausting the native stack.
+constexpr size_t kMaxImageDepth = 4096;
+
+// Throws RuntimeError if an object nests deeper than kMaxImageDepth.
+std::string WriteImage(const std::vector<std::shared_ptr<Object>>& objects);
+
+// Throws SyntaxError on a malformed image, including one nested deeper than kMaxImageDepth.
+std::vector<std::shared_ptr<Object>> ReadImage(const char* data, size_t size);
+
+std::vector<std::shared_ptr<Object>> LoadImage(const std::string& path);
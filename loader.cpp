@@ -0,0 +1,189 @@
+#include "loader.h"
+#include "parser.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <exception>
+#include <istream>
+#include <optional>
+#include <streambuf>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kChunksPerThread = 4;
+
+class ViewBuffer : public std::streambuf {
+public:
+    ViewBuffer(std::string_view text) {
+        char* data = const_cast<char*>(text.data());
+        setg(data, data, data + text.size());
+    }
+};
+
+enum CharClass : uint8_t { kOther, kSpace, kOpen, kClose, kQuote, kDoubleQuote };
+
+struct CharTable {
+    CharClass classes[256] = {};
+
+    constexpr CharTable() {
+        for (char c : {' ', '\t', '\n', '\v', '\f', '\r'}) {
+            classes[static_cast<uint8_t>(c)] = kSpace;
+        }
+        classes[static_cast<uint8_t>('(')] = kOpen;
+        classes[static_cast<uint8_t>(')')] = kClose;
+        for (char c : {'\'', '`', ',', '@'}) {
+            classes[static_cast<uint8_t>(c)] = kQuote;
+        }
+        classes[static_cast<uint8_t>('"')] = kDoubleQuote;
+    }
+};
+
+constexpr CharTable kChars;
+
+std::vector<std::shared_ptr<Object>> ReadChunk(std::string_view text, HashConsStats* dedup) {
+    ViewBuffer buffer(text);
+    std::istream in(&buffer);
+    Tokenizer tokenizer(&in);
+    std::optional<HashConsTable> table;
+    if (dedup) {
+        table.emplace();
+    }
+    std::vector<std::shared_ptr<Object>> res;
+    while (!tokenizer.IsEnd()) {
+        res.push_back(Read(&tokenizer, table ? &*table : nullptr));
+    }
+    if (dedup) {
+        *dedup += table->GetStats();
+    }
+    return res;
+}
+
+}  // namespace
+
+std::vector<size_t> SplitForms(std::string_view text, size_t chunks) {
+    std::vector<size_t> res{0};
+    size_t step = std::max(text.size() / std::max<size_t>(chunks, 1), kMinChunkSize);
+    size_t next = step;
+    size_t depth = 0;
+    CharClass prev = kSpace;
+    for (size_t i = 0; i < text.size(); ++i) {
+        CharClass cls = kChars.classes[static_cast<uint8_t>(text[i])];
+        if (cls == kOther) {
+            prev = kOther;
+            continue;
+        }
+        if (cls == kSpace) {
+            if (depth == 0 && i >= next && prev != kQuote) {
+                res.push_back(i);
+                next = i + step;
+            }
+            continue;
+        }
+        if (cls == kDoubleQuote) {
+            for (++i; i < text.size() && text[i] != '"'; ++i) {
+                i += text[i] == '\\';
+            }
+        } else if (cls == kOpen) {
+            ++depth;
+        } else if (cls == kClose && depth) {
+            --depth;
+        }
+        prev = cls;
+    }
+    res.push_back(text.size());
+    return res;
+}
+
+std::vector<std::shared_ptr<Object>> ReadAll(std::string_view text, size_t threads,
+                                             HashConsStats* dedup) {
+    if (!threads) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (threads == 1) {
+        return ReadChunk(text, dedup);
+    }
+    auto bounds = SplitForms(text, threads * kChunksPerThread);
+    size_t chunks = bounds.size() - 1;
+    if (chunks == 1) {
+        return ReadChunk(text, dedup);
+    }
+    std::vector<std::vector<std::shared_ptr<Object>>> parts(chunks);
+    std::vector<HashConsStats> stats(dedup ? chunks : 0);
+    std::vector<std::exception_ptr> errors(chunks);
+    std::atomic<size_t> next = 0;
+    auto work = [&] {
+        for (size_t i = next++; i < chunks; i = next++) {
+            try {
+                parts[i] = ReadChunk(text.substr(bounds[i], bounds[i + 1] - bounds[i]),
+                                     dedup ? &stats[i] : nullptr);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < std::min(threads, chunks); ++i) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < chunks; ++i) {
+        if (errors[i]) {
+            std::rethrow_exception(errors[i]);
+        }
+        total += parts[i].size();
+    }
+    for (auto& chunk : stats) {
+        *dedup += chunk;
+    }
+    std::vector<std::shared_ptr<Object>> res;
+    res.reserve(total);
+    for (auto& part : parts) {
+        std::move(part.begin(), part.end(), std::back_inserter(res));
+    }
+    return res;
+}
+
+std::vector<std::shared_ptr<Object>> LoadForms(const std::string& path, size_t threads,
+                                               HashConsStats* dedup) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), path);
+    }
+    size_t size = st.st_size;
+    if (size == 0) {
+        close(fd);
+        return {};
+    }
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    try {
+        auto res = ReadAll(std::string_view(static_cast<const char*>(data), size), threads, dedup);
+        munmap(data, size);
+        return res;
+    } catch (...) {
+        munmap(data, size);
+        throw;
+    }
+}
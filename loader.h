@@ -0,0 +1,27 @@
+#pragma once
+
+#include "hashcons.h"
+#include "object.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Smallest chunk SplitForms cuts, so short inputs are read by one thread.
+constexpr size_t kMinChunkSize = 1 << 16;
+
+// Offsets that cut text into about the given number of chunks, each a run of whole top-level
+// forms: cuts fall on whitespace outside any list or string and never right after a quote
+// prefix. The first offset is 0 and the last text.size().
+std::vector<size_t> SplitForms(std::string_view text, size_t chunks);
+
+// Reads every top-level form of text, on up to threads threads (0 for one per core), in order.
+// With dedup set, each chunk is read through its own HashConsTable, so identical subtrees within
+// a chunk share one node, and the tables' statistics are added to *dedup.
+std::vector<std::shared_ptr<Object>> ReadAll(std::string_view text, size_t threads = 0,
+                                             HashConsStats* dedup = nullptr);
+
+// ReadAll over the mapped contents of the file at path.
+std::vector<std::shared_ptr<Object>> LoadForms(const std::string& path, size_t threads = 0,
+                                               HashConsStats* dedup = nullptr);
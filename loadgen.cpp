@@ -0,0 +1,498 @@
+// Replays a log of expressions, one per line, against Interpreter::Run and reports latency,
+// throughput, errors and peak RSS as JSON.
+//
+//   loadgen replay LOG [--rate N] [--concurrency N] [--requests N] [--duration S] [--out FILE]
+//   loadgen compare BASE.json NEW.json [--threshold PCT]
+//   loadgen dedup FILE [--threads N]
+//
+// With --rate requests are sent open loop: request k is due at start + k / rate and its latency
+// is measured from that moment, so a stalled worker shows up as latency instead of as a lower
+// send rate. Without --rate every worker sends its next request as soon as the previous one
+// finished. Each worker owns an interpreter forked from one snapshot; define-syntax lines are
+// applied to that snapshot before timing starts and are not replayed.
+//
+// dedup loads a file of top-level forms with and without hash-consing and reports, as JSON, how
+// many nodes were read, how many were unique, and the object bytes the forms retain each way.
+
+#include "error.h"
+#include "hashtable.h"
+#include "loader.h"
+#include "scheme.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/resource.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Log-linear histogram of nanosecond values: exact below 128, then 128 buckets per power of
+// two, which bounds the relative error of a reported percentile by 1/128.
+class Histogram {
+public:
+    static constexpr int kSubBits = 7;
+    static constexpr size_t kSubBuckets = size_t{1} << kSubBits;
+    static constexpr size_t kBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+    Histogram() : counts_(kBuckets) {
+    }
+
+    void Record(uint64_t value) {
+        ++counts_[Index(value)];
+        ++total_;
+        sum_ += value;
+        max_ = std::max(max_, value);
+    }
+
+    void Merge(const Histogram& other) {
+        for (size_t i = 0; i < kBuckets; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        sum_ += other.sum_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    // Highest value equivalent to the q-th quantile.
+    uint64_t Percentile(double q) const {
+        if (total_ == 0) {
+            return 0;
+        }
+        auto rank = std::max<uint64_t>(1, std::ceil(q * total_));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                return std::min(UpperBound(i), max_);
+            }
+        }
+        return max_;
+    }
+
+    uint64_t Total() const {
+        return total_;
+    }
+
+    uint64_t Max() const {
+        return max_;
+    }
+
+    double Mean() const {
+        return total_ ? static_cast<double>(sum_) / total_ : 0;
+    }
+
+private:
+    static size_t Index(uint64_t value) {
+        if (value < kSubBuckets) {
+            return value;
+        }
+        int shift = std::bit_width(value) - kSubBits - 1;
+        return (shift + 1) * kSubBuckets + ((value >> shift) - kSubBuckets);
+    }
+
+    static uint64_t UpperBound(size_t index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        int shift = index / kSubBuckets - 1;
+        uint64_t mantissa = index % kSubBuckets + kSubBuckets;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+enum ErrorType { kSyntaxError, kRuntimeError, kNameError, kLimitError, kOtherError, kErrorTypes };
+
+constexpr const char* kErrorNames[kErrorTypes] = {"SyntaxError", "RuntimeError", "NameError",
+                                                  "LimitError", "other"};
+
+struct WorkerResult {
+    Histogram latency;
+    std::array<uint64_t, kErrorTypes> errors{};
+};
+
+struct ReplayOptions {
+    std::string log;
+    std::string out;
+    double rate = 0;
+    size_t concurrency = 1;
+    size_t requests = 0;
+    double duration = 0;
+};
+
+[[noreturn]] void Usage() {
+    std::cerr << "usage: loadgen replay LOG [--rate N] [--concurrency N] [--requests N]"
+                 " [--duration S] [--out FILE]\n"
+                 "       loadgen compare BASE.json NEW.json [--threshold PCT]\n"
+                 "       loadgen dedup FILE [--threads N]\n";
+    std::exit(2);
+}
+
+double ParseNumber(const char* text) {
+    char* end;
+    double res = std::strtod(text, &end);
+    if (end == text || *end || res < 0) {
+        Usage();
+    }
+    return res;
+}
+
+std::string Trim(const std::string& line) {
+    auto begin = line.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    return line.substr(begin, line.find_last_not_of(" \t\r") - begin + 1);
+}
+
+size_t PeakRssKb() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void RunOne(Interpreter* interpreter, const std::string& expression, WorkerResult* result) {
+    try {
+        interpreter->Run(expression);
+    } catch (const SyntaxError&) {
+        ++result->errors[kSyntaxError];
+    } catch (const RuntimeError&) {
+        ++result->errors[kRuntimeError];
+    } catch (const NameError&) {
+        ++result->errors[kNameError];
+    } catch (const LimitError&) {
+        ++result->errors[kLimitError];
+    } catch (const std::exception&) {
+        ++result->errors[kOtherError];
+    }
+}
+
+int Replay(const ReplayOptions& options) {
+    std::ifstream in(options.log);
+    if (!in) {
+        std::cerr << "loadgen: cannot open " << options.log << "\n";
+        return 1;
+    }
+    Interpreter setup;
+    std::vector<std::string> lines;
+    size_t definitions = 0;
+    for (std::string line; std::getline(in, line);) {
+        line = Trim(line);
+        if (line.empty()) {
+            continue;
+        }
+        if (line.starts_with("(define-syntax")) {
+            try {
+                setup.Run(line);
+            } catch (const std::exception& e) {
+                std::cerr << "loadgen: " << e.what() << " in " << line << "\n";
+                return 1;
+            }
+            ++definitions;
+            continue;
+        }
+        lines.push_back(std::move(line));
+    }
+    if (lines.empty()) {
+        std::cerr << "loadgen: " << options.log << " has no expressions\n";
+        return 1;
+    }
+    auto snapshot = setup.Snapshot();
+    size_t requests = options.requests;
+    if (!requests) {
+        requests = options.duration > 0 ? SIZE_MAX : lines.size();
+    }
+
+    std::vector<WorkerResult> results(options.concurrency);
+    std::atomic<size_t> next = 0;
+    auto start = Clock::now() + std::chrono::milliseconds(10);
+    auto deadline = start + std::chrono::duration_cast<Clock::duration>(
+                                std::chrono::duration<double>(options.duration));
+    auto worker = [&](WorkerResult* result) {
+        Interpreter interpreter(snapshot);
+        std::this_thread::sleep_until(start);
+        while (true) {
+            size_t k = next.fetch_add(1, std::memory_order_relaxed);
+            if (k >= requests) {
+                return;
+            }
+            Clock::time_point begin;
+            if (options.rate > 0) {
+                begin = start + std::chrono::duration_cast<Clock::duration>(
+                                    std::chrono::duration<double>(k / options.rate));
+                std::this_thread::sleep_until(begin);
+            } else {
+                begin = Clock::now();
+            }
+            if (options.duration > 0 && begin >= deadline) {
+                return;
+            }
+            RunOne(&interpreter, lines[k % lines.size()], result);
+            result->latency.Record(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin)
+                    .count());
+        }
+    };
+    std::vector<std::thread> threads;
+    for (auto& result : results) {
+        threads.emplace_back(worker, &result);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    WorkerResult total;
+    for (auto& result : results) {
+        total.latency.Merge(result.latency);
+        for (size_t i = 0; i < kErrorTypes; ++i) {
+            total.errors[i] += result.errors[i];
+        }
+    }
+    auto& latency = total.latency;
+    std::ostringstream report;
+    report << "{\"log\":" << String{options.log}.ToString() << ",\"expressions\":" << lines.size()
+           << ",\"definitions\":" << definitions << ",\"rate\":" << options.rate
+           << ",\"concurrency\":" << options.concurrency << ",\"requests\":" << latency.Total()
+           << ",\"seconds\":" << seconds
+           << ",\"throughput_rps\":" << (seconds > 0 ? latency.Total() / seconds : 0)
+           << ",\"latency_ns\":{\"p50\":" << latency.Percentile(0.5)
+           << ",\"p99\":" << latency.Percentile(0.99) << ",\"p999\":" << latency.Percentile(0.999)
+           << ",\"max\":" << latency.Max() << ",\"mean\":" << latency.Mean() << "},\"errors\":{";
+    uint64_t errors = 0;
+    for (size_t i = 0; i < kErrorTypes; ++i) {
+        report << "\"" << kErrorNames[i] << "\":" << total.errors[i] << ",";
+        errors += total.errors[i];
+    }
+    report << "\"total\":" << errors << "},\"peak_rss_kb\":" << PeakRssKb() << "}\n";
+
+    if (options.out.empty()) {
+        std::cout << report.str();
+    } else {
+        std::ofstream(options.out) << report.str();
+    }
+    std::fprintf(stderr, "%llu requests in %.2fs: %.0f req/s, p50 %.1fus p99 %.1fus p999 %.1fus, "
+                         "%llu errors\n",
+                 static_cast<unsigned long long>(latency.Total()), seconds,
+                 latency.Total() / seconds, latency.Percentile(0.5) / 1e3,
+                 latency.Percentile(0.99) / 1e3, latency.Percentile(0.999) / 1e3,
+                 static_cast<unsigned long long>(errors));
+    return 0;
+}
+
+// Number stored under key, or under key.subkey, in a report written by Replay. The subkey is
+// searched after the key, which is enough for that fixed layout.
+bool ReportValue(const std::string& report, const char* key, const char* subkey, double* value) {
+    size_t pos = 0;
+    for (auto name : {key, subkey}) {
+        if (!name) {
+            break;
+        }
+        pos = report.find("\"" + std::string(name) + "\":", pos);
+        if (pos == std::string::npos) {
+            return false;
+        }
+        pos += std::strlen(name) + 3;
+    }
+    char* end;
+    *value = std::strtod(report.c_str() + pos, &end);
+    return end != report.c_str() + pos;
+}
+
+int Compare(const std::string& base_path, const std::string& new_path, double threshold) {
+    std::string reports[2];
+    const std::string* paths[2] = {&base_path, &new_path};
+    for (int i = 0; i < 2; ++i) {
+        std::ifstream in(*paths[i]);
+        if (!in) {
+            std::cerr << "loadgen: cannot open " << *paths[i] << "\n";
+            return 1;
+        }
+        reports[i].assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    struct Metric {
+        const char* name;
+        const char* key;
+        const char* subkey;
+        bool higher_is_better;
+        bool gated;
+    };
+    const Metric metrics[] = {
+        {"throughput_rps", "throughput_rps", nullptr, true, true},
+        {"p50_ns", "latency_ns", "p50", false, false},
+        {"p99_ns", "latency_ns", "p99", false, true},
+        {"p999_ns", "latency_ns", "p999", false, false},
+        {"max_ns", "latency_ns", "max", false, false},
+        {"errors", "errors", "total", false, false},
+        {"peak_rss_kb", "peak_rss_kb", nullptr, false, false},
+    };
+    bool regressed = false;
+    std::printf("%-16s %14s %14s %9s\n", "metric", "base", "new", "change");
+    for (auto& metric : metrics) {
+        double before, after;
+        if (!ReportValue(reports[0], metric.key, metric.subkey, &before) ||
+            !ReportValue(reports[1], metric.key, metric.subkey, &after)) {
+            std::cerr << "loadgen: " << metric.name << " missing from a report\n";
+            return 1;
+        }
+        double change = before ? (after - before) / before * 100 : 0;
+        bool worse = metric.higher_is_better ? change < -threshold : change > threshold;
+        if (metric.gated && threshold > 0 && worse) {
+            regressed = true;
+        }
+        std::printf("%-16s %14.0f %14.0f %+8.1f%%%s\n", metric.name, before, after, change,
+                    metric.gated && threshold > 0 && worse ? "  REGRESSION" : "");
+    }
+    return regressed ? 1 : 0;
+}
+
+// Bytes of the distinct objects reachable from forms, counted the way the heap stats count them:
+// each object and its out-of-line payload, once however many forms share it.
+size_t RetainedBytes(const std::vector<std::shared_ptr<Object>>& forms) {
+    std::unordered_set<const Object*> seen;
+    std::vector<const Object*> pending;
+    for (auto& form : forms) {
+        pending.push_back(form.get());
+    }
+    size_t res = 0;
+    while (!pending.empty()) {
+        auto obj = pending.back();
+        pending.pop_back();
+        if (!obj || !seen.insert(obj).second) {
+            continue;
+        }
+        if (auto cell = dynamic_cast<const Cell*>(obj)) {
+            res += sizeof(Cell);
+            pending.push_back(cell->GetFirst().get());
+            pending.push_back(cell->GetSecond().get());
+        } else if (auto vector = dynamic_cast<const Vector*>(obj)) {
+            auto& items = vector->GetItems();
+            res += sizeof(Vector) + items.capacity() * sizeof(items[0]);
+            for (auto& item : items) {
+                pending.push_back(item.get());
+            }
+        } else if (auto table = dynamic_cast<const HashTable*>(obj)) {
+            auto& entries = table->GetEntries();
+            res += sizeof(HashTable) + entries.capacity() * sizeof(entries[0]);
+            for (auto& entry : entries) {
+                pending.push_back(entry.key.get());
+                pending.push_back(entry.value.get());
+            }
+        } else if (auto symbol = dynamic_cast<const Symbol*>(obj)) {
+            res += sizeof(Symbol) + HeapBytes(symbol->GetName());
+        } else if (auto str = dynamic_cast<const String*>(obj)) {
+            res += sizeof(String) + HeapBytes(str->GetValue());
+        } else if (dynamic_cast<const Flonum*>(obj)) {
+            res += sizeof(Flonum);
+        } else if (dynamic_cast<const Bool*>(obj)) {
+            res += sizeof(Bool);
+        } else {
+            res += sizeof(Number);
+        }
+    }
+    return res;
+}
+
+int Dedup(const std::string& path, size_t threads) {
+    try {
+        auto begin = Clock::now();
+        auto plain = LoadForms(path, threads);
+        double plain_seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+        size_t plain_bytes = RetainedBytes(plain);
+        plain.clear();
+
+        HashConsStats stats;
+        begin = Clock::now();
+        auto shared = LoadForms(path, threads, &stats);
+        double shared_seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+        size_t shared_bytes = RetainedBytes(shared);
+
+        std::cout << "{\"file\":" << String{path}.ToString() << ",\"forms\":" << shared.size()
+                  << ",\"nodes\":" << stats.nodes << ",\"unique\":" << stats.unique
+                  << ",\"dedup_ratio\":" << stats.DedupRatio()
+                  << ",\"retained_bytes\":{\"plain\":" << plain_bytes
+                  << ",\"hash_consed\":" << shared_bytes
+                  << "},\"load_seconds\":{\"plain\":" << plain_seconds
+                  << ",\"hash_consed\":" << shared_seconds << "}}\n";
+    } catch (const std::exception& e) {
+        std::cerr << "loadgen: " << e.what() << " in " << path << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        Usage();
+    }
+    std::string command = argv[1];
+    if (command == "replay") {
+        ReplayOptions options;
+        options.log = argv[2];
+        for (int i = 3; i < argc; ++i) {
+            std::string flag = argv[i];
+            if (i + 1 == argc) {
+                Usage();
+            }
+            const char* value = argv[++i];
+            if (flag == "--rate") {
+                options.rate = ParseNumber(value);
+            } else if (flag == "--concurrency") {
+                options.concurrency = std::max<size_t>(1, ParseNumber(value));
+            } else if (flag == "--requests") {
+                options.requests = ParseNumber(value);
+            } else if (flag == "--duration") {
+                options.duration = ParseNumber(value);
+            } else if (flag == "--out") {
+                options.out = value;
+            } else {
+                Usage();
+            }
+        }
+        return Replay(options);
+    }
+    if (command == "compare" && (argc == 4 || argc == 6)) {
+        double threshold = 0;
+        if (argc == 6) {
+            if (std::string(argv[4]) != "--threshold") {
+                Usage();
+            }
+            threshold = ParseNumber(argv[5]);
+        }
+        return Compare(argv[2], argv[3], threshold);
+    }
+    if (command == "dedup" && (argc == 3 || argc == 5)) {
+        size_t threads = 0;
+        if (argc == 5) {
+            if (std::string(argv[3]) != "--threads") {
+                Usage();
+            }
+            threads = ParseNumber(argv[4]);
+        }
+        return Dedup(argv[2], threads);
+    }
+    Usage();
+}
@@ -0,0 +1,375 @@
+#include "macro.h"
+#include "error.h"
+#include "parser.h"
+
+#include <typeinfo>
+
+namespace {
+
+constexpr size_t kMaxExpansions = 1 << 16;
+constexpr const char* kEllipsis = "...";
+
+bool IsSymbol(const std::shared_ptr<Object>& obj, const char* name) {
+    auto symbol = dynamic_cast<const Symbol*>(obj.get());
+    return symbol && symbol->GetName() == name;
+}
+
+const Symbol* AsSymbol(const std::shared_ptr<Object>& obj) {
+    return dynamic_cast<const Symbol*>(obj.get());
+}
+
+const Cell* AsCell(const std::shared_ptr<Object>& obj) {
+    return dynamic_cast<const Cell*>(obj.get());
+}
+
+// Builds a list the way the reader would build it from the printed elements.
+std::shared_ptr<Object> MakeList(std::vector<std::shared_ptr<Object>> items,
+                                 std::shared_ptr<Object> tail) {
+    if (items.empty()) {
+        return tail;
+    }
+    if (tail) {
+        items.push_back(std::make_shared<Symbol>("."));
+        items.push_back(std::move(tail));
+    }
+    return MakeCell(items);
+}
+
+bool IsEllipsis(const std::vector<std::shared_ptr<Object>>& items, size_t i) {
+    return i + 1 < items.size() && IsSymbol(items[i + 1], kEllipsis);
+}
+
+bool IsEmptyList(const std::shared_ptr<Object>& obj) {
+    auto cell = AsCell(obj);
+    return !obj || (cell && !cell->GetFirst() && !cell->GetSecond());
+}
+
+struct ExpandState {
+    size_t budget = kMaxExpansions;
+    const ExpansionStep& step;
+};
+
+std::shared_ptr<Object> ExpandForm(const std::shared_ptr<Object>& form, const MacroTable& macros,
+                                   ExpandState* state);
+
+std::shared_ptr<Object> ExpandQuasi(const std::shared_ptr<Object>& form, const MacroTable& macros,
+                                    size_t depth, ExpandState* state) {
+    auto cell = AsCell(form);
+    if (!cell) {
+        return form;
+    }
+    auto head = AsSymbol(cell->GetFirst());
+    if (head && AsCell(cell->GetSecond())) {
+        auto& name = head->GetName();
+        size_t inner = depth;
+        if (name == "quasiquote") {
+            ++inner;
+        } else if (name == "unquote" || name == "unquote-splicing") {
+            --inner;
+        }
+        if (inner != depth) {
+            auto operand = AsCell(cell->GetSecond())->GetFirst();
+            auto expanded = inner == 0 ? ExpandForm(operand, macros, state)
+                                       : ExpandQuasi(operand, macros, inner, state);
+            if (expanded == operand) {
+                return form;
+            }
+            return RebuildList({cell->GetFirst(), expanded}, nullptr);
+        }
+    }
+    std::vector<std::shared_ptr<Object>> items;
+    std::shared_ptr<Object> tail;
+    ListElements(form, &items, &tail);
+    bool changed = false;
+    for (auto& item : items) {
+        auto expanded = ExpandQuasi(item, macros, depth, state);
+        changed |= expanded != item;
+        item = std::move(expanded);
+    }
+    return changed ? RebuildList(items, tail) : form;
+}
+
+std::shared_ptr<Object> ExpandForm(const std::shared_ptr<Object>& form, const MacroTable& macros,
+                                   ExpandState* state) {
+    auto cur = form;
+    while (true) {
+        auto cell = AsCell(cur);
+        auto head = cell ? AsSymbol(cell->GetFirst()) : nullptr;
+        if (!head) {
+            break;
+        }
+        auto it = macros.find(head->GetName());
+        if (it == macros.end()) {
+            if (head->GetName() == "quote") {
+                return cur;
+            }
+            if (head->GetName() == "quasiquote") {
+                return ExpandQuasi(cur, macros, 0, state);
+            }
+            break;
+        }
+        if (state->budget-- == 0) {
+            throw RuntimeError();
+        }
+        if (state->step) {
+            state->step();
+        }
+        cur = it->second.Expand(cur, state->step);
+        if (!cur) {
+            throw SyntaxError();
+        }
+    }
+    if (!AsCell(cur)) {
+        return cur;
+    }
+    std::vector<std::shared_ptr<Object>> items;
+    std::shared_ptr<Object> tail;
+    ListElements(cur, &items, &tail);
+    bool changed = cur != form;
+    for (auto& item : items) {
+        auto expanded = ExpandForm(item, macros, state);
+        changed |= expanded != item;
+        item = std::move(expanded);
+    }
+    return changed ? RebuildList(items, tail) : cur;
+}
+
+}  // namespace
+
+void ListElements(const std::shared_ptr<Object>& list, std::vector<std::shared_ptr<Object>>* items,
+                  std::shared_ptr<Object>* tail) {
+    auto cur = list;
+    while (auto cell = AsCell(cur)) {
+        items->push_back(cell->GetFirst());
+        cur = cell->GetSecond();
+    }
+    *tail = cur;
+}
+
+std::shared_ptr<Object> RebuildList(const std::vector<std::shared_ptr<Object>>& items,
+                                    std::shared_ptr<Object> tail) {
+    for (size_t i = items.size(); i > 0; --i) {
+        tail = std::make_shared<Cell>(items[i - 1], std::move(tail));
+    }
+    if (!items.empty()) {
+        static_cast<Cell&>(*tail).CountList(items.size());
+    }
+    return tail;
+}
+
+SyntaxRules::SyntaxRules(const std::shared_ptr<Object>& spec) {
+    std::vector<std::shared_ptr<Object>> items;
+    std::shared_ptr<Object> tail;
+    ListElements(spec, &items, &tail);
+    if (items.size() < 2 || tail || !IsSymbol(items[0], "syntax-rules")) {
+        throw SyntaxError();
+    }
+    std::vector<std::shared_ptr<Object>> literals;
+    ListElements(items[1], &literals, &tail);
+    for (auto& literal : literals) {
+        auto symbol = AsSymbol(literal);
+        if (!symbol || tail) {
+            throw SyntaxError();
+        }
+        literals_.insert(symbol->GetName());
+    }
+    for (size_t i = 2; i < items.size(); ++i) {
+        std::vector<std::shared_ptr<Object>> rule;
+        ListElements(items[i], &rule, &tail);
+        if (rule.size() != 2 || tail || !AsCell(rule[0])) {
+            throw SyntaxError();
+        }
+        rules_.push_back({rule[0], rule[1]});
+    }
+}
+
+std::shared_ptr<Object> SyntaxRules::Expand(const std::shared_ptr<Object>& form,
+                                            const ExpansionStep& step) const {
+    for (auto& rule : rules_) {
+        Bindings bindings;
+        // The keyword position of a pattern is ignored.
+        auto pattern = AsCell(rule.pattern)->GetSecond();
+        if (Match(pattern, AsCell(form)->GetSecond(), &bindings)) {
+            return Instantiate(rule.templ, Scope{&bindings, nullptr, {}}, step);
+        }
+    }
+    return nullptr;
+}
+
+const SyntaxRules::Binding* SyntaxRules::Scope::Find(const std::string& name) const {
+    for (auto scope = this; scope; scope = scope->parent) {
+        for (auto& [var, binding] : scope->items) {
+            if (*var == name) {
+                return binding;
+            }
+        }
+        if (scope->bindings) {
+            auto it = scope->bindings->find(name);
+            return it != scope->bindings->end() ? &it->second : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+void SyntaxRules::CollectVariables(const std::shared_ptr<Object>& pattern,
+                                   std::vector<std::string>* vars) const {
+    if (auto symbol = AsSymbol(pattern)) {
+        auto& name = symbol->GetName();
+        if (name != "_" && name != kEllipsis && !literals_.count(name)) {
+            vars->push_back(name);
+        }
+    } else if (auto cell = AsCell(pattern)) {
+        CollectVariables(cell->GetFirst(), vars);
+        CollectVariables(cell->GetSecond(), vars);
+    }
+}
+
+bool SyntaxRules::Match(const std::shared_ptr<Object>& pattern,
+                        const std::shared_ptr<Object>& form, Bindings* bindings) const {
+    if (auto symbol = AsSymbol(pattern)) {
+        auto& name = symbol->GetName();
+        if (literals_.count(name)) {
+            return IsSymbol(form, name.c_str());
+        }
+        if (name != "_") {
+            (*bindings)[name].value = form;
+        }
+        return true;
+    }
+    if (IsEmptyList(pattern)) {
+        return IsEmptyList(form);
+    }
+    if (!AsCell(pattern)) {
+        return form && typeid(*form) == typeid(*pattern) && form->ToString() == pattern->ToString();
+    }
+    if (form && !AsCell(form)) {
+        return false;
+    }
+    std::vector<std::shared_ptr<Object>> patterns, forms;
+    std::shared_ptr<Object> pattern_tail, form_tail;
+    ListElements(pattern, &patterns, &pattern_tail);
+    ListElements(form, &forms, &form_tail);
+    size_t ellipsis = patterns.size();
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        if (IsEllipsis(patterns, i)) {
+            ellipsis = i;
+            break;
+        }
+    }
+    if (ellipsis == patterns.size()) {
+        if (pattern_tail) {
+            if (forms.size() < patterns.size()) {
+                return false;
+            }
+        } else if (forms.size() != patterns.size() || form_tail) {
+            return false;
+        }
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            if (!Match(patterns[i], forms[i], bindings)) {
+                return false;
+            }
+        }
+        if (!pattern_tail) {
+            return true;
+        }
+        std::vector<std::shared_ptr<Object>> rest(forms.begin() + patterns.size(), forms.end());
+        return Match(pattern_tail, RebuildList(rest, form_tail), bindings);
+    }
+    size_t after = patterns.size() - ellipsis - 2;
+    if (pattern_tail || form_tail || forms.size() < ellipsis + after) {
+        return false;
+    }
+    for (size_t i = 0; i < ellipsis; ++i) {
+        if (!Match(patterns[i], forms[i], bindings)) {
+            return false;
+        }
+    }
+    std::vector<std::string> vars;
+    CollectVariables(patterns[ellipsis], &vars);
+    for (auto& var : vars) {
+        (*bindings)[var].sequence = true;
+    }
+    size_t repeated = forms.size() - ellipsis - after;
+    for (size_t i = 0; i < repeated; ++i) {
+        Bindings item;
+        if (!Match(patterns[ellipsis], forms[ellipsis + i], &item)) {
+            return false;
+        }
+        for (auto& var : vars) {
+            (*bindings)[var].items.push_back(std::move(item[var]));
+        }
+    }
+    for (size_t i = 0; i < after; ++i) {
+        if (!Match(patterns[ellipsis + 2 + i], forms[ellipsis + repeated + i], bindings)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<Object> SyntaxRules::Instantiate(const std::shared_ptr<Object>& templ,
+                                                 const Scope& scope,
+                                                 const ExpansionStep& step) const {
+    if (step) {
+        step();
+    }
+    if (auto symbol = AsSymbol(templ)) {
+        auto binding = scope.Find(symbol->GetName());
+        if (!binding) {
+            return templ;
+        }
+        if (binding->sequence) {
+            throw SyntaxError();
+        }
+        return binding->value;
+    }
+    if (!AsCell(templ) || IsEmptyList(templ)) {
+        return templ;
+    }
+    std::vector<std::shared_ptr<Object>> templs, items;
+    std::shared_ptr<Object> tail;
+    ListElements(templ, &templs, &tail);
+    if (templs.size() == 2 && IsSymbol(templs[0], kEllipsis)) {
+        return templs[1];
+    }
+    for (size_t i = 0; i < templs.size(); ++i) {
+        if (!IsEllipsis(templs, i)) {
+            items.push_back(Instantiate(templs[i], scope, step));
+            continue;
+        }
+        std::vector<std::string> vars;
+        CollectVariables(templs[i], &vars);
+        // Each repetition sees the sequence variables bound to their k-th item through a frame
+        // over the enclosing scope; nothing else is copied.
+        Scope frame{nullptr, &scope, {}};
+        std::vector<const Binding*> sequences;
+        for (auto& var : vars) {
+            auto binding = scope.Find(var);
+            if (!binding || !binding->sequence) {
+                continue;
+            }
+            if (!sequences.empty() && binding->items.size() != sequences[0]->items.size()) {
+                throw SyntaxError();
+            }
+            sequences.push_back(binding);
+            frame.items.emplace_back(&var, nullptr);
+        }
+        if (sequences.empty()) {
+            throw SyntaxError();
+        }
+        for (size_t k = 0; k < sequences[0]->items.size(); ++k) {
+            for (size_t j = 0; j < sequences.size(); ++j) {
+                frame.items[j].second = &sequences[j]->items[k];
+            }
+            items.push_back(Instantiate(templs[i], frame, step));
+        }
+        ++i;
+    }
+    return MakeList(std::move(items), tail ? Instantiate(tail, scope, step) : nullptr);
+}
+
+std::shared_ptr<Object> ExpandMacros(const std::shared_ptr<Object>& form, const MacroTable& macros,
+                                     const ExpansionStep& step) {
+    ExpandState state{kMaxExpansions, step};
+    return ExpandForm(form, macros, &state);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "object.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Splits a list into its elements and the final cdr, which is null for a proper list.
+void ListElements(const std::shared_ptr<Object>& list, std::vector<std::shared_ptr<Object>>* items,
+                  std::shared_ptr<Object>* tail);
+
+// Inverse of ListElements that keeps the exact cell structure.
+std::shared_ptr<Object> RebuildList(const std::vector<std::shared_ptr<Object>>& items,
+                                    std::shared_ptr<Object> tail);
+
+// Called once per unit of expansion work, so that the caller can bound it.
+using ExpansionStep = std::function<void()>;
+
+class SyntaxRules {
+public:
+    // Parses (syntax-rules (literal ...) (pattern template) ...).
+    explicit SyntaxRules(const std::shared_ptr<Object>& spec);
+
+    // Rewrites form with the first rule whose pattern matches it, or returns nullptr.
+    std::shared_ptr<Object> Expand(const std::shared_ptr<Object>& form,
+                                   const ExpansionStep& step = {}) const;
+
+private:
+    struct Rule {
+        std::shared_ptr<Object> pattern;
+        std::shared_ptr<Object> templ;
+    };
+
+    struct Binding {
+        std::shared_ptr<Object> value;
+        std::vector<Binding> items;
+        bool sequence = false;
+    };
+
+    using Bindings = std::unordered_map<std::string, Binding>;
+
+    // The bindings a template sees: the match results, overlaid by one frame per ellipsis being
+    // instantiated that holds the current item of each of its variables.
+    struct Scope {
+        const Bindings* bindings = nullptr;
+        const Scope* parent = nullptr;
+        std::vector<std::pair<const std::string*, const Binding*>> items;
+
+        const Binding* Find(const std::string& name) const;
+    };
+
+    bool Match(const std::shared_ptr<Object>& pattern, const std::shared_ptr<Object>& form,
+               Bindings* bindings) const;
+    std::shared_ptr<Object> Instantiate(const std::shared_ptr<Object>& templ, const Scope& scope,
+                                        const ExpansionStep& step) const;
+    void CollectVariables(const std::shared_ptr<Object>& pattern,
+                          std::vector<std::string>* vars) const;
+
+    std::unordered_set<std::string> literals_;
+    std::vector<Rule> rules_;
+};
+
+using MacroTable = std::unordered_map<std::string, SyntaxRules>;
+
+// Expands every macro use in form until none is left. Quoted data is left alone, and inside a
+// quasiquote only the unquoted parts are expanded. Unchanged subtrees are shared with form. step
+// is called for every macro use and every template node instantiated.
+std::shared_ptr<Object> ExpandMacros(const std::shared_ptr<Object>& form, const MacroTable& macros,
+                                     const ExpansionStep& step = {});
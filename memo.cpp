@@ -0,0 +1,60 @@
+#include "memo.h"
+#include "error.h"
+
+#include <vector>
+
+// Evaluates the arguments of a constant arithmetic call into *args and returns the builtin that
+// applies to them, or nullptr when node is not such a call.
+static IFunction* EvaluateArgs(const std::shared_ptr<Object>& node, const FunctionTable& funcs,
+                               std::vector<std::shared_ptr<Object>>* args) {
+    if (!Is<Cell>(node) || !Is<Symbol>(As<Cell>(node)->GetFirst())) {
+        return nullptr;
+    }
+    auto symbol = As<Symbol>(As<Cell>(node)->GetFirst());
+    int32_t slot = symbol->GetSlot();
+    if (slot < 0) {
+        slot = FindFunctionSlot(symbol->GetName());
+    }
+    if (slot < 0 || static_cast<size_t>(slot) >= funcs.size() || !funcs[slot].func) {
+        return nullptr;
+    }
+    auto kind = funcs[slot].kind;
+    if (kind < BuiltinKind::kAdd || kind > BuiltinKind::kAbs) {
+        return nullptr;
+    }
+    for (auto cur = As<Cell>(node)->GetSecond(); cur;) {
+        if (!Is<Cell>(cur)) {
+            return nullptr;
+        }
+        auto cell = As<Cell>(cur);
+        auto& arg = cell->GetFirst();
+        if (Is<Number>(arg) || Is<Flonum>(arg)) {
+            args->push_back(arg);
+        } else {
+            std::vector<std::shared_ptr<Object>> inner;
+            auto func = EvaluateArgs(arg, funcs, &inner);
+            if (!func) {
+                return nullptr;
+            }
+            args->push_back(func->InvokeValue(inner));
+        }
+        cur = cell->GetSecond();
+    }
+    return funcs[slot].func.get();
+}
+
+std::unique_ptr<MemoizedResult> MemoizedResult::Make(const std::shared_ptr<Object>& expression,
+                                                     const FunctionTable& funcs) {
+    std::vector<std::shared_ptr<Object>> args;
+    try {
+        auto func = EvaluateArgs(expression, funcs, &args);
+        if (!func) {
+            return nullptr;
+        }
+        std::string result;
+        func->InvokeTo(args, &result);
+        return std::unique_ptr<MemoizedResult>(new MemoizedResult(std::move(result)));
+    } catch (const RuntimeError&) {
+        return nullptr;
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "functions.h"
+#include "object.h"
+
+#include <memory>
+#include <string>
+
+// The printed result of a hot expression. Only numeric constants combined by the arithmetic and
+// comparison builtins are memoized, so the same builtin table always gives the same value: the
+// expression is evaluated once, through the builtins themselves, and Run replays the result.
+// Registering a builtin drops every memoized result, which keeps them valid.
+class MemoizedResult {
+public:
+    // nullptr when the expression is not constant arithmetic or its evaluation fails, e.g. on
+    // overflow, so the interpreter keeps evaluating it and raising the error.
+    static std::unique_ptr<MemoizedResult> Make(const std::shared_ptr<Object>& expression,
+                                                const FunctionTable& funcs);
+
+    void Run(std::string* out) const {
+        out->append(result_);
+    }
+
+private:
+    explicit MemoizedResult(std::string result) : result_(std::move(result)) {
+    }
+
+    std::string result_;
+};
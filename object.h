@@ -1,41 +1,134 @@
 #pragma once
 
+#include "heapstats.h"
+
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+inline void AppendNumber(int64_t value, std::string* out) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    out->append(buf, res.ptr);
+}
+
+// Shortest text that reads back to the same double. A '.' or an exponent is always present, so
+// the text never reads back as a fixnum.
+inline void AppendFlonum(double value, std::string* out) {
+    if (std::isnan(value)) {
+        out->append("+nan.0");
+        return;
+    }
+    if (std::isinf(value)) {
+        out->append(value > 0 ? "+inf.0" : "-inf.0");
+        return;
+    }
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    out->append(buf, res.ptr);
+    for (char* c = buf; c != res.ptr; ++c) {
+        if (*c == '.' || *c == 'e') {
+            return;
+        }
+    }
+    out->append(".0");
+}
+
+// Inverse of AppendFlonum, also accepting a leading '+'. The whole text must be consumed.
+inline bool ParseFlonum(std::string_view text, double* value) {
+    if (text == "+inf.0" || text == "-inf.0") {
+        *value = (text[0] == '+' ? 1 : -1) * std::numeric_limits<double>::infinity();
+        return true;
+    }
+    if (text == "+nan.0" || text == "-nan.0") {
+        *value = std::numeric_limits<double>::quiet_NaN();
+        return true;
+    }
+    if (text.starts_with('+')) {
+        text.remove_prefix(1);
+    }
+    auto res = std::from_chars(text.data(), text.data() + text.size(), *value);
+    return res.ec == std::errc{} && res.ptr == text.data() + text.size();
+}
 
 class Object : public std::enable_shared_from_this<Object> {
 public:
     virtual ~Object() = default;
-    virtual std::string ToString() = 0;
+    virtual void Print(std::string* out) const = 0;
+
+    std::string ToString() const {
+        std::string res;
+        Print(&res);
+        return res;
+    }
 };
 
 class Number : public Object {
 public:
-    Number(int v) : val_(v) {
+    Number(int64_t v) : val_(v) {
+        CountAllocation(ObjectType::kNumber, sizeof(Number), this);
+    }
+
+    ~Number() override {
+        CountRelease(ObjectType::kNumber, sizeof(Number), this);
     }
 
     int64_t GetValue() const {
         return val_;
     }
 
-    std::string ToString() override {
-        return std::to_string(val_);
+    void Print(std::string* out) const override {
+        AppendNumber(val_, out);
     }
 
 private:
     int64_t val_;
 };
 
+class Flonum : public Object {
+public:
+    Flonum(double v) : val_(v) {
+        CountAllocation(ObjectType::kFlonum, sizeof(Flonum), this);
+    }
+
+    ~Flonum() override {
+        CountRelease(ObjectType::kFlonum, sizeof(Flonum), this);
+    }
+
+    double GetValue() const {
+        return val_;
+    }
+
+    void Print(std::string* out) const override {
+        AppendFlonum(val_, out);
+    }
+
+private:
+    double val_;
+};
+
 class Bool : public Object {
 public:
     Bool(bool b) : bool_(b) {
+        CountAllocation(ObjectType::kBool, sizeof(Bool), this);
+    }
+
+    ~Bool() override {
+        CountRelease(ObjectType::kBool, sizeof(Bool), this);
     }
 
-    bool GetBool() {
+    bool GetBool() const {
         return bool_;
     }
 
-    std::string ToString() override {
-        return (bool_) ? "#t" : "#f";
+    void Print(std::string* out) const override {
+        out->append((bool_) ? "#t" : "#f");
     }
 
 private:
@@ -45,48 +138,212 @@ private:
 class Symbol : public Object {
 public:
     Symbol(const std::string& s) : name_(s) {
+        CountAllocation(ObjectType::kSymbol, sizeof(Symbol) + HeapBytes(name_), this);
+    }
+
+    ~Symbol() override {
+        CountRelease(ObjectType::kSymbol, sizeof(Symbol) + HeapBytes(name_), this);
     }
 
     const std::string& GetName() const {
         return name_;
     }
 
-    std::string ToString() override {
-        return name_;
+    int32_t GetSlot() const {
+        return slot_.load(std::memory_order_relaxed);
+    }
+
+    void SetSlot(int32_t slot) const {
+        slot_.store(slot, std::memory_order_relaxed);
+    }
+
+    void Print(std::string* out) const override {
+        out->append(name_);
     }
 
 private:
     std::string name_;
+    mutable std::atomic<int32_t> slot_ = -1;
+};
+
+class String : public Object {
+public:
+    String(const std::string& s) : value_(s) {
+        CountAllocation(ObjectType::kString, sizeof(String) + HeapBytes(value_), this);
+    }
+
+    ~String() override {
+        CountRelease(ObjectType::kString, sizeof(String) + HeapBytes(value_), this);
+    }
+
+    const std::string& GetValue() const {
+        return value_;
+    }
+
+    void Print(std::string* out) const override {
+        out->push_back('"');
+        for (char c : value_) {
+            if (c == '"' || c == '\\') {
+                out->push_back('\\');
+            }
+            out->push_back(c);
+        }
+        out->push_back('"');
+    }
+
+private:
+    std::string value_;
 };
 
 class Cell : public Object {
 public:
     Cell(const std::shared_ptr<Object>& f, const std::shared_ptr<Object>& s)
         : first_(f), second_(s) {
+        CountAllocation(ObjectType::kCell, sizeof(Cell), this);
+    }
+
+    ~Cell() override {
+        CountRelease(ObjectType::kCell, sizeof(Cell), this);
+#ifdef SCHEME_HEAP_STATS
+        if (structure_) {
+            ReleaseStructure(this);
+        }
+#endif
+        auto next = std::move(second_);
+        while (next && next.use_count() == 1 && dynamic_cast<Cell*>(next.get())) {
+            next = std::move(static_cast<Cell*>(next.get())->second_);
+        }
     }
 
-    std::shared_ptr<Object> GetFirst() const {
+    const std::shared_ptr<Object>& GetFirst() const {
         return first_;
     }
-    std::shared_ptr<Object> GetSecond() const {
+    const std::shared_ptr<Object>& GetSecond() const {
         return second_;
     }
 
-    std::string ToString() override {
-        if (first_ && second_) {
-            return first_->ToString() + second_->ToString();
+    void Print(std::string* out) const override;
+
+    // Reports the list this cell heads, with its spine of the given length, to the heap stats,
+    // where a long list is then listed as one structure.
+    void CountList([[maybe_unused]] size_t cells) {
+#ifdef SCHEME_HEAP_STATS
+        if (!structure_) {
+            structure_ = CountStructure(cells * sizeof(Cell), this);
+        }
+#endif
+    }
+
+private:
+    std::shared_ptr<Object> first_, second_;
+#ifdef SCHEME_HEAP_STATS
+    bool structure_ = false;
+#endif
+};
+
+// Prints a datum with lists in their written form: nested lists in parentheses, an improper tail
+// after " . ", () for the empty list. Lists are walked with an explicit stack of the rests still
+// to print, so nesting depth costs no native stack.
+inline void PrintDatum(const Object* obj, std::string* out) {
+    auto empty = [](const Object* o) {
+        auto cell = dynamic_cast<const Cell*>(o);
+        return !o || (cell && !cell->GetFirst() && !cell->GetSecond());
+    };
+    if (empty(obj)) {
+        out->append("()");
+        return;
+    }
+    if (!dynamic_cast<const Cell*>(obj)) {
+        obj->Print(out);
+        return;
+    }
+    out->push_back('(');
+    std::vector<const Object*> rests{obj};
+    bool open = true;
+    while (!rests.empty()) {
+        auto rest = rests.back();
+        if (empty(rest)) {
+            rests.pop_back();
+            out->push_back(')');
+            open = false;
+            continue;
+        }
+        if (!open) {
+            out->push_back(' ');
+        }
+        open = false;
+        auto cell = dynamic_cast<const Cell*>(rest);
+        if (!cell) {
+            out->append(". ");
+            rest->Print(out);
+            rests.back() = nullptr;
+            continue;
         }
-        if (first_) {
-            return first_->ToString();
+        rests.back() = cell->GetSecond().get();
+        auto item = cell->GetFirst().get();
+        if (empty(item)) {
+            out->append("()");
+        } else if (dynamic_cast<const Cell*>(item)) {
+            out->push_back('(');
+            rests.push_back(item);
+            open = true;
+        } else {
+            item->Print(out);
         }
-        if (second_) {
-            return second_->ToString();
+    }
+}
+
+inline void Cell::Print(std::string* out) const {
+    PrintDatum(this, out);
+}
+
+class Vector : public Object {
+public:
+    Vector(std::vector<std::shared_ptr<Object>> items) : items_(std::move(items)) {
+        CountAllocation(ObjectType::kVector, Bytes(), this);
+    }
+
+    ~Vector() override {
+        CountRelease(ObjectType::kVector, Bytes(), this);
+    }
+
+    size_t Size() const {
+        return items_.size();
+    }
+
+    const std::shared_ptr<Object>& Get(size_t i) const {
+        return items_[i];
+    }
+
+    const std::vector<std::shared_ptr<Object>>& GetItems() const {
+        return items_;
+    }
+
+    void Set(size_t i, std::shared_ptr<Object> item) {
+        items_[i] = std::move(item);
+    }
+
+    void Print(std::string* out) const override {
+        PrintItems(items_, out);
+    }
+
+    static void PrintItems(const std::vector<std::shared_ptr<Object>>& items, std::string* out) {
+        out->append("#(");
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (i > 0) {
+                out->push_back(' ');
+            }
+            PrintDatum(items[i].get(), out);
         }
-        return "()";
+        out->push_back(')');
     }
 
 private:
-    std::shared_ptr<Object> first_, second_;
+    size_t Bytes() const {
+        return sizeof(Vector) + items_.capacity() * sizeof(std::shared_ptr<Object>);
+    }
+
+    std::vector<std::shared_ptr<Object>> items_;
 };
 
 template <class T>
@@ -1,84 +1,192 @@
 #include "parser.h"
 #include "error.h"
+#include "hashtable.h"
 
-std::shared_ptr<Object> MakeCell(std::queue<std::shared_ptr<Object>>& objects) {
+#include <charconv>
+#include <sstream>
+
+static bool IsSymbol(const std::shared_ptr<Object>& obj, const char* name) {
+    auto symbol = dynamic_cast<Symbol*>(obj.get());
+    return symbol && symbol->GetName() == name;
+}
+
+std::shared_ptr<Object> MakeCell(const std::vector<std::shared_ptr<Object>>& objects,
+                                 HashConsTable* table) {
+    auto make = [table](const std::shared_ptr<Object>& first, std::shared_ptr<Object> second) {
+        std::shared_ptr<Object> cell = std::make_shared<Cell>(first, std::move(second));
+        return table ? table->Intern(std::move(cell)) : cell;
+    };
     if (objects.empty()) {
         return nullptr;
     }
-    std::shared_ptr<Object> first, second;
-    first = objects.front();
-    objects.pop();
-    if (Is<Symbol>(first) && As<Symbol>(first)->GetName() == ".") {
-        throw SyntaxError();
-    }
-    if (objects.empty()) {
-        second = nullptr;
-    } else if (objects.size() == 1 && !objects.front()) {
-        if (Is<Symbol>(first)) {
-            second = std::make_shared<Cell>(nullptr, nullptr);
-        }
-    } else if (Is<Symbol>(objects.front()) && As<Symbol>(objects.front())->GetName() == ".") {
-        if (objects.size() == 2) {
-            second = objects.back();
-            objects.pop();
-            objects.pop();
-        } else {
+    size_t size = objects.size();
+    size_t last = 0;
+    std::shared_ptr<Object> tail;
+    while (true) {
+        if (IsSymbol(objects[last], ".")) {
             throw SyntaxError();
         }
-    } else {
-        second = MakeCell(objects);
+        size_t rest = size - last - 1;
+        if (rest == 0) {
+            break;
+        }
+        if (rest == 1 && !objects[last + 1]) {
+            if (Is<Symbol>(objects[last])) {
+                tail = make(nullptr, nullptr);
+            }
+            break;
+        }
+        if (IsSymbol(objects[last + 1], ".")) {
+            if (rest != 2) {
+                throw SyntaxError();
+            }
+            tail = objects.back();
+            break;
+        }
+        ++last;
+    }
+    size_t cells = last + 1;
+    auto res = make(objects[last], tail);
+    while (last > 0) {
+        --last;
+        res = make(objects[last], std::move(res));
     }
-    return std::make_shared<Cell>(first, second);
+    static_cast<Cell&>(*res).CountList(cells);
+    return res;
 }
 
-std::shared_ptr<Object> Read(Tokenizer* tokenizer) {
+std::shared_ptr<Object> Read(Tokenizer* tokenizer, HashConsTable* table) {
     if (tokenizer->IsEnd()) {
         throw SyntaxError();
     }
     auto token = tokenizer->GetToken();
     tokenizer->Next();
 
+    auto intern = [table](std::shared_ptr<Object> obj) {
+        return table ? table->Intern(std::move(obj)) : obj;
+    };
     if (ConstantToken* x = std::get_if<ConstantToken>(&token)) {
-        return std::make_shared<Number>(x->value);
+        return intern(std::make_shared<Number>(x->value));
+    } else if (FloatToken* x = std::get_if<FloatToken>(&token)) {
+        return intern(std::make_shared<Flonum>(x->value));
     } else if (BoolToken* b = std::get_if<BoolToken>(&token)) {
-        return std::make_shared<Bool>(b->bool_);
+        return intern(std::make_shared<Bool>(b->bool_));
     } else if (SymbolToken* symbol = std::get_if<SymbolToken>(&token)) {
-        return std::make_shared<Symbol>(symbol->name);
-    } else if (std::get_if<QuoteToken>(&token)) {
+        return intern(std::make_shared<Symbol>(symbol->name));
+    } else if (std::get_if<QuoteToken>(&token) || std::get_if<QuasiquoteToken>(&token) ||
+               std::get_if<UnquoteToken>(&token)) {
         if (tokenizer->IsEnd()) {
             throw SyntaxError();
         }
-        std::queue<std::shared_ptr<Object>> objects;
-        objects.push(std::make_shared<Symbol>("quote"));
-        auto arg = Read(tokenizer);
-        objects.push(arg);
-        return MakeCell(objects);
+        const char* name = "quote";
+        if (std::get_if<QuasiquoteToken>(&token)) {
+            name = "quasiquote";
+        } else if (auto unquote = std::get_if<UnquoteToken>(&token)) {
+            name = unquote->splicing ? "unquote-splicing" : "unquote";
+        }
+        auto arg = Read(tokenizer, table);
+        return MakeCell({intern(std::make_shared<Symbol>(name)), arg}, table);
+    } else if (StringToken* str = std::get_if<StringToken>(&token)) {
+        return intern(std::make_shared<String>(str->value));
+    } else if (std::get_if<VectorToken>(&token)) {
+        return ReadVector(tokenizer, table);
+    } else if (std::get_if<HashTableToken>(&token)) {
+        return ReadHashTable(tokenizer, table);
     } else if (std::get_if<DotToken>(&token)) {
         return std::make_shared<Symbol>(".");
     } else if (BracketToken* bracket = std::get_if<BracketToken>(&token)) {
         if (*bracket == BracketToken::CLOSE) {
             return std::make_shared<Symbol>(")");
         } else {
-            return ReadList(tokenizer);
+            return ReadList(tokenizer, table);
         }
     }
     return nullptr;
 }
 
-std::shared_ptr<Object> ReadList(Tokenizer* tokenizer) {
+std::shared_ptr<Object> ReadList(Tokenizer* tokenizer, HashConsTable* table) {
     if (tokenizer->IsEnd()) {
         throw SyntaxError();
     }
-    std::queue<std::shared_ptr<Object>> objects;
+    std::vector<std::shared_ptr<Object>> objects;
     while (true) {
-        auto tmp = Read(tokenizer);
-        if (Is<Symbol>(tmp) && As<Symbol>(tmp)->GetName() == ")") {
+        auto tmp = Read(tokenizer, table);
+        if (IsSymbol(tmp, ")")) {
             break;
         }
-        objects.push(tmp);
+        objects.push_back(std::move(tmp));
+        if (tokenizer->IsEnd()) {
+            throw SyntaxError();
+        }
+    }
+    return MakeCell(objects, table);
+}
+
+std::shared_ptr<Object> ReadVector(Tokenizer* tokenizer, HashConsTable* table) {
+    std::vector<std::shared_ptr<Object>> items;
+    while (true) {
         if (tokenizer->IsEnd()) {
             throw SyntaxError();
         }
+        auto tmp = Read(tokenizer, table);
+        if (IsSymbol(tmp, ")")) {
+            break;
+        }
+        if (IsSymbol(tmp, ".")) {
+            throw SyntaxError();
+        }
+        items.push_back(std::move(tmp));
+    }
+    std::shared_ptr<Object> res = std::make_shared<Vector>(std::move(items));
+    return table ? table->Intern(std::move(res)) : res;
+}
+
+std::shared_ptr<Object> ReadHashTable(Tokenizer* tokenizer, HashConsTable* table) {
+    auto res = std::make_shared<HashTable>();
+    while (true) {
+        if (tokenizer->IsEnd()) {
+            throw SyntaxError();
+        }
+        auto tmp = Read(tokenizer, table);
+        if (IsSymbol(tmp, ")")) {
+            break;
+        }
+        auto entry = dynamic_cast<const Cell*>(tmp.get());
+        if (!entry || !(Is<Number>(entry->GetFirst()) || Is<Symbol>(entry->GetFirst()))) {
+            throw SyntaxError();
+        }
+        res->Set(entry->GetFirst(), entry->GetSecond());
+    }
+    return res;
+}
+
+std::shared_ptr<Object> ReadValue(std::string_view str) {
+    if (str.empty()) {
+        return nullptr;
+    }
+    if (str == "#t" || str == "#f") {
+        return std::make_shared<Bool>(str == "#t");
+    }
+    if (str[0] == '-' || std::isdigit(str[0]) || (str[0] == '+' && str.size() > 1)) {
+        int64_t value;
+        auto res = std::from_chars(str.data(), str.data() + str.size(), value);
+        if (res.ec == std::errc{} && res.ptr == str.data() + str.size()) {
+            return std::make_shared<Number>(value);
+        }
+        double real;
+        if (!ParseFlonum(str, &real)) {
+            throw RuntimeError();
+        }
+        return std::make_shared<Flonum>(real);
+    }
+    if (str[0] == '"' || str.substr(0, 2) == "#(" || str.starts_with("#hash(")) {
+        std::stringstream in{std::string(str)};
+        Tokenizer tokenizer{&in};
+        auto res = Read(&tokenizer);
+        if (!tokenizer.IsEnd()) {
+            throw SyntaxError();
+        }
+        return res;
     }
-    return MakeCell(objects);
+    return std::make_shared<Symbol>(std::string(str));
 }
@@ -1,13 +1,22 @@
 #pragma once
 
+#include "hashcons.h"
 #include "object.h"
 #include "tokenizer.h"
 
 #include <memory>
-#include <queue>
+#include <string_view>
+#include <vector>
 
-std::shared_ptr<Object> MakeCell(std::queue<std::shared_ptr<Object>>& objects);
+std::shared_ptr<Object> MakeCell(const std::vector<std::shared_ptr<Object>>& objects,
+                                 HashConsTable* table = nullptr);
 
-std::shared_ptr<Object> Read(Tokenizer* tokenizer);
+std::shared_ptr<Object> Read(Tokenizer* tokenizer, HashConsTable* table = nullptr);
 
-std::shared_ptr<Object> ReadList(Tokenizer* tokenizer);
\ No newline at end of file
+std::shared_ptr<Object> ReadList(Tokenizer* tokenizer, HashConsTable* table = nullptr);
+
+std::shared_ptr<Object> ReadVector(Tokenizer* tokenizer, HashConsTable* table = nullptr);
+
+std::shared_ptr<Object> ReadHashTable(Tokenizer* tokenizer, HashConsTable* table = nullptr);
+
+std::shared_ptr<Object> ReadValue(std::string_view str);
@@ -3,49 +3,221 @@
 #include "scheme.h"
 #include "tokenizer.h"
 
+#include <algorithm>
 #include <sstream>
 
-Interpreter::Interpreter() {
-    funcs_["quote"] = std::make_shared<QuoteFunction>(QuoteFunction{});
-    funcs_["+"] = std::make_unique<AddFunction>(AddFunction{});
-    funcs_["*"] = std::make_shared<MultiplyFunction>(MultiplyFunction{});
-    funcs_["-"] = std::make_shared<SubstrFunction>(SubstrFunction{});
-    funcs_["/"] = std::make_shared<DivideFunction>(DivideFunction{});
-    funcs_["max"] = std::make_shared<MaxFunction>(MaxFunction{});
-    funcs_["min"] = std::make_shared<MinFunction>(MinFunction{});
-    funcs_["abs"] = std::make_shared<AbsFunction>(AbsFunction{});
-    funcs_["number?"] = std::make_shared<NumberFunction>(NumberFunction{});
-    funcs_["="] = std::make_shared<EqFunction>(EqFunction{});
-    funcs_[">"] = std::make_shared<GFunction>(GFunction{});
-    funcs_[">="] = std::make_shared<GEqFunction>(GEqFunction{});
-    funcs_["<"] = std::make_shared<LFunction>(LFunction{});
-    funcs_["<="] = std::make_shared<LEqFunction>(LEqFunction{});
-    funcs_["boolean?"] = std::make_shared<BoolFunction>(BoolFunction{});
-    funcs_["not"] = std::make_shared<NotFunction>(NotFunction{});
-    funcs_["pair?"] = std::make_shared<PairFunction>(PairFunction{});
-    funcs_["list?"] = std::make_shared<ListFunction>(ListFunction{});
-    funcs_["null?"] = std::make_shared<NullFunction>(NullFunction{});
-    funcs_["and"] = std::make_shared<AndFunction>(AndFunction{});
-    funcs_["or"] = std::make_shared<OrFunction>(OrFunction{});
-    funcs_["cons"] = std::make_shared<ConsFunction>(ConsFunction{});
-    funcs_["car"] = std::make_shared<CarFunction>(CarFunction{});
-    funcs_["cdr"] = std::make_shared<CdrFunction>(CdrFunction{});
-    funcs_["list"] = std::make_shared<MakeListFunction>(MakeListFunction{});
-    funcs_["list-ref"] = std::make_shared<RefFunction>(RefFunction{});
-    funcs_["list-tail"] = std::make_shared<TailFunction>(TailFunction{});
-}
-
-std::shared_ptr<Object> Interpreter::CheckString(const std::string &obj) {
-    if (obj.empty()) {
+static std::shared_ptr<const FunctionTable> DefaultFunctions() {
+    static const auto kFuncs = [] {
+        auto funcs = std::make_shared<FunctionTable>();
+        auto add = [&funcs](const std::string &name, std::shared_ptr<IFunction> func) {
+            size_t slot = FunctionSlot(name);
+            if (funcs->size() <= slot) {
+                funcs->resize(slot + 1);
+            }
+            auto kind = GetBuiltinKind(func.get());
+            (*funcs)[slot] = Builtin{std::move(func), kind};
+        };
+        add("quote", std::make_shared<QuoteFunction>(QuoteFunction{}));
+        add("quasiquote", std::make_shared<QuasiquoteFunction>(QuasiquoteFunction{}));
+        add("+", std::make_shared<AddFunction>(AddFunction{}));
+        add("*", std::make_shared<MultiplyFunction>(MultiplyFunction{}));
+        add("-", std::make_shared<SubstrFunction>(SubstrFunction{}));
+        add("/", std::make_shared<DivideFunction>(DivideFunction{}));
+        add("max", std::make_shared<MaxFunction>(MaxFunction{}));
+        add("min", std::make_shared<MinFunction>(MinFunction{}));
+        add("abs", std::make_shared<AbsFunction>(AbsFunction{}));
+        add("number?", std::make_shared<NumberFunction>(NumberFunction{}));
+        add("=", std::make_shared<EqFunction>(EqFunction{}));
+        add(">", std::make_shared<GFunction>(GFunction{}));
+        add(">=", std::make_shared<GEqFunction>(GEqFunction{}));
+        add("<", std::make_shared<LFunction>(LFunction{}));
+        add("<=", std::make_shared<LEqFunction>(LEqFunction{}));
+        add("boolean?", std::make_shared<BoolFunction>(BoolFunction{}));
+        add("not", std::make_shared<NotFunction>(NotFunction{}));
+        add("pair?", std::make_shared<PairFunction>(PairFunction{}));
+        add("list?", std::make_shared<ListFunction>(ListFunction{}));
+        add("null?", std::make_shared<NullFunction>(NullFunction{}));
+        add("and", std::make_shared<AndFunction>(AndFunction{}));
+        add("or", std::make_shared<OrFunction>(OrFunction{}));
+        add("cons", std::make_shared<ConsFunction>(ConsFunction{}));
+        add("car", std::make_shared<CarFunction>(CarFunction{}));
+        add("cdr", std::make_shared<CdrFunction>(CdrFunction{}));
+        add("list", std::make_shared<MakeListFunction>(MakeListFunction{}));
+        add("list-ref", std::make_shared<RefFunction>(RefFunction{}));
+        add("list-tail", std::make_shared<TailFunction>(TailFunction{}));
+        add("make-vector", std::make_shared<MakeVectorFunction>(MakeVectorFunction{}));
+        add("vector-ref", std::make_shared<VectorRefFunction>(VectorRefFunction{}));
+        add("vector-set!", std::make_shared<VectorSetFunction>(VectorSetFunction{}));
+        add("vector-length", std::make_shared<VectorLengthFunction>(VectorLengthFunction{}));
+        add("vector-map", std::make_shared<VectorMapFunction>(VectorMapFunction{}));
+        add("vector-fold", std::make_shared<VectorFoldFunction>(VectorFoldFunction{}));
+        add("make-hash-table", std::make_shared<MakeHashTableFunction>(MakeHashTableFunction{}));
+        add("alist->hash-table",
+            std::make_shared<AlistToHashTableFunction>(AlistToHashTableFunction{}));
+        add("hash-ref", std::make_shared<HashRefFunction>(HashRefFunction{}));
+        add("hash-set!", std::make_shared<HashSetFunction>(HashSetFunction{}));
+        add("hash-count", std::make_shared<HashCountFunction>(HashCountFunction{}));
+        add("string-append", std::make_shared<StringAppendFunction>(StringAppendFunction{}));
+        add("substring", std::make_shared<SubstringFunction>(SubstringFunction{}));
+        add("map", std::make_shared<MapFunction>(MapFunction{}));
+        add("filter", std::make_shared<FilterFunction>(FilterFunction{}));
+        add("fold-left", std::make_shared<FoldLeftFunction>(FoldLeftFunction{}));
+        add("fold-right", std::make_shared<FoldRightFunction>(FoldRightFunction{}));
+        add("apply", std::make_shared<ApplyFunction>(ApplyFunction{}));
+        add("length", std::make_shared<LengthFunction>(LengthFunction{}));
+        add("append", std::make_shared<AppendFunction>(AppendFunction{}));
+        add("reverse", std::make_shared<ReverseFunction>(ReverseFunction{}));
+        return funcs;
+    }();
+    return kFuncs;
+}
+
+static constexpr int64_t kStepQuantum = 1024;
+static constexpr size_t kMaxHotExpressions = 4096;
+
+static bool IsCall(const std::shared_ptr<Object> &obj) {
+    return Is<Cell>(obj) && Is<Symbol>(As<Cell>(obj)->GetFirst());
+}
+
+// True for a (name operand) form.
+static bool IsForm(const std::shared_ptr<Object> &obj, const char *name) {
+    auto cell = dynamic_cast<const Cell *>(obj.get());
+    if (!cell || !Is<Cell>(cell->GetSecond())) {
+        return false;
+    }
+    auto head = dynamic_cast<const Symbol *>(cell->GetFirst().get());
+    return head && head->GetName() == name;
+}
+
+Interpreter::Interpreter() : funcs_(DefaultFunctions()) {
+}
+
+Interpreter::Interpreter(const InterpreterSnapshot &snapshot)
+    : funcs_(snapshot.funcs),
+      limits_(snapshot.limits),
+      memo_threshold_(snapshot.memo_threshold),
+      memos_(snapshot.memos),
+      macros_(snapshot.macros) {
+}
+
+InterpreterSnapshot Interpreter::Snapshot() const {
+    auto memos = memos_;
+    if (std::any_of(hot_.begin(), hot_.end(), [](auto &hot) { return hot.second.memo; })) {
+        auto table = memos_ ? std::make_shared<MemoTable>(*memos_) : std::make_shared<MemoTable>();
+        for (auto &[expression, hot] : hot_) {
+            if (hot.memo) {
+                table->emplace(expression, hot.memo);
+            }
+        }
+        memos = std::move(table);
+    }
+    auto limits = limits_;
+    limits.cancel = nullptr;
+    return {funcs_, std::move(memos), macros_, limits, memo_threshold_};
+}
+
+const Builtin *Interpreter::Lookup(const Symbol &symbol) const {
+    int32_t slot = symbol.GetSlot();
+    if (slot < 0) {
+        slot = FindFunctionSlot(symbol.GetName());
+        if (slot < 0) {
+            return nullptr;
+        }
+        symbol.SetSlot(slot);
+    }
+    if (static_cast<size_t>(slot) >= funcs_->size() || !(*funcs_)[slot].func) {
         return nullptr;
     }
-    if (obj == "#t" || obj == "#f") {
-        return std::make_shared<Bool>(Bool{obj == "#t"});
+    return &(*funcs_)[slot];
+}
+
+void Interpreter::SetLimits(const EvalLimits &limits) {
+    limits_ = limits;
+}
+
+void Interpreter::SetMemoThreshold(size_t threshold) {
+    memo_threshold_ = threshold;
+    hot_.clear();
+}
+
+const MemoizedResult *Interpreter::FindMemo(const std::string &expression) const {
+    if (memos_) {
+        auto it = memos_->find(expression);
+        if (it != memos_->end()) {
+            return it->second.get();
+        }
     }
-    if (obj[0] == '-' || std::isdigit(obj[0])) {
-        return std::make_shared<Number>(Number{std::stoi(obj)});
+    auto it = hot_.find(expression);
+    return it != hot_.end() ? it->second.memo.get() : nullptr;
+}
+
+bool Interpreter::UseMemos() const {
+    return memo_threshold_ && !limits_.max_steps && !limits_.max_depth && !limits_.max_bytes &&
+           !limits_.cancel;
+}
+
+void Interpreter::Profile(const std::string &expression, const std::shared_ptr<Object> &obj) {
+    auto it = hot_.find(expression);
+    if (it == hot_.end()) {
+        if (hot_.size() >= kMaxHotExpressions) {
+            return;
+        }
+        it = hot_.emplace(expression, HotExpression{}).first;
+    }
+    if (++it->second.count == memo_threshold_) {
+        it->second.memo = MemoizedResult::Make(obj, *funcs_);
     }
-    return std::make_shared<Symbol>(Symbol{obj});
+}
+
+void Interpreter::Step() {
+    if (--budget_ <= 0) {
+        CheckLimits();
+    }
+}
+
+void Interpreter::CheckLimits() {
+    steps_ += quantum_;
+    if (limits_.max_steps && steps_ > limits_.max_steps) {
+        throw LimitError();
+    }
+    if (limits_.cancel && limits_.cancel->IsCancelled()) {
+        throw LimitError();
+    }
+    quantum_ = kStepQuantum;
+    if (limits_.max_steps) {
+        quantum_ = std::min<int64_t>(quantum_, limits_.max_steps + 1 - steps_);
+    }
+    budget_ = quantum_;
+}
+
+void Interpreter::CheckNesting(const std::string &expression) {
+    size_t depth = 0;
+    bool in_string = false;
+    for (size_t i = 0; i < expression.size(); ++i) {
+        char c = expression[i];
+        if (in_string) {
+            if (c == '\\') {
+                ++i;
+            } else if (c == '"') {
+                in_string = false;
+            }
+        } else if (c == '"') {
+            in_string = true;
+        } else if (c == '(') {
+            if (++depth > limits_.max_depth) {
+                throw LimitError();
+            }
+        } else if (c == ')' && depth > 0) {
+            --depth;
+        }
+    }
+}
+
+std::shared_ptr<Object> Interpreter::EvaluateArg(std::shared_ptr<Cell> object, bool optimizer) {
+    std::shared_ptr<Object> res;
+    Evaluate(object, &scratch_, optimizer, &res);
+    ChargeAllocation(sizeof(Cell));
+    return res;
 }
 
 void Interpreter::UnpackArgs(std::vector<std::shared_ptr<Object>> &args,
@@ -57,97 +229,769 @@ void Interpreter::UnpackArgs(std::vector<std::shared_ptr<Object>> &args,
         args.push_back(object);
         return;
     }
-    auto obj = As<Cell>(object);
-    if (!obj->GetFirst()) {
-        args.push_back(nullptr);
+    auto obj = static_cast<const Cell *>(object.get());
+    while (true) {
+        auto &first = obj->GetFirst();
+        if (!first) {
+            args.push_back(nullptr);
+            return;
+        }
+        if (Is<Cell>(first)) {
+            auto cell = As<Cell>(first);
+            if (cell->GetFirst() && Is<Symbol>(cell->GetFirst())) {
+                args.push_back(EvaluateArg(cell, optimizer));
+            } else {
+                if (limits_.max_depth && depth_ >= limits_.max_depth) {
+                    throw LimitError();
+                }
+                ++depth_;
+                UnpackArgs(args, cell, optimizer);
+                --depth_;
+            }
+        } else {
+            args.push_back(first);
+        }
+        auto &second = obj->GetSecond();
+        if (!second) {
+            return;
+        }
+        if (!Is<Cell>(second)) {
+            args.push_back(second);
+            return;
+        }
+        auto cell = static_cast<const Cell *>(second.get());
+        if (cell->GetFirst() && Is<Symbol>(cell->GetFirst())) {
+            args.push_back(EvaluateArg(As<Cell>(second)));
+            return;
+        }
+        obj = cell;
+    }
+}
+
+void Interpreter::Evaluate(std::shared_ptr<Cell> object, std::string *out, bool optimizer,
+                           std::shared_ptr<Object> *value) {
+    Step();
+    if (limits_.max_depth && depth_ >= limits_.max_depth) {
+        throw LimitError();
+    }
+    ++depth_;
+    EvaluateCall(object, out, optimizer, value);
+    --depth_;
+}
+
+void Interpreter::CallBuiltin(IFunction &func, size_t base, std::string *out,
+                              std::shared_ptr<Object> *value) {
+    auto args = ArgSpan(stack_).subspan(base);
+    if (value) {
+        *value = func.InvokeValue(args);
+    } else {
+        func.InvokeTo(args, out);
+    }
+    stack_.resize(base);
+}
+
+void Interpreter::EvaluateCall(std::shared_ptr<Cell> object, std::string *out, bool optimizer,
+                               std::shared_ptr<Object> *value) {
+    auto first = object->GetFirst();
+    if (!first || !Is<Symbol>(first)) {
+        throw RuntimeError();
+    }
+    auto second = object->GetSecond();
+    auto symbol = As<Symbol>(first);
+
+    auto builtin = Lookup(*symbol);
+    if (!builtin) {
+        if (!optimizer) {
+            throw NameError();
+        }
+        if (value) {
+            *value = first;
+        } else {
+            out->append(symbol->GetName());
+        }
         return;
     }
-    if (Is<Cell>(obj->GetFirst())) {
-        auto cell = As<Cell>(obj->GetFirst());
-        if (cell->GetFirst() && Is<Symbol>(cell->GetFirst())) {
-            auto res = Evaluate(cell, optimizer);
-            args.push_back(CheckString(res));
+    auto &func = builtin->func;
+    size_t base = stack_.size();
+    if (builtin->kind == BuiltinKind::kQuote) {
+        auto cell = As<Cell>(second);
+        stack_.push_back(cell->GetFirst());
+        CallBuiltin(*func, base, out, value);
+        return;
+    }
+    if (builtin->kind == BuiltinKind::kQuasiquote) {
+        if (!Is<Cell>(second)) {
+            throw RuntimeError();
+        }
+        auto res = Quasiquote(As<Cell>(second)->GetFirst(), 1);
+        if (value) {
+            *value = res ? res : EmptyList();
         } else {
-            UnpackArgs(args, cell, optimizer);
+            PrintDatum(res.get(), out);
         }
-    } else {
-        args.push_back(obj->GetFirst());
+        return;
+    }
+    if (builtin->kind == BuiltinKind::kAnd || builtin->kind == BuiltinKind::kOr) {
+        optimizer = true;
     }
-    if (!obj->GetSecond()) {
+    size_t mark = scratch_.size();
+    if (!EvaluateBinary(builtin->kind, second, value ? &scratch_ : out, optimizer)) {
+        UnpackArgs(stack_, second, optimizer);
+    } else if (stack_.size() == base) {
+        if (value) {
+            *value = ReadValue(std::string_view(scratch_).substr(mark));
+            scratch_.resize(mark);
+        }
         return;
     }
-    if (Is<Cell>(obj->GetSecond())) {
-        auto cell = As<Cell>(obj->GetSecond());
-        if (cell->GetFirst() && Is<Symbol>(cell->GetFirst())) {
-            auto res = Evaluate(cell);
-            args.push_back(CheckString(res));
+    PrepareArgs(*builtin, base);
+    CallBuiltin(*func, base, out, value);
+}
+
+void Interpreter::PrepareArgs(const Builtin &builtin, size_t base) {
+    if (stack_.size() - base > 1 && !stack_.back()) {
+        stack_.pop_back();
+    }
+    ChargeAllocation((stack_.size() - base) * sizeof(std::shared_ptr<Object>));
+    if (builtin.func->TakesProcedures()) {
+        for (size_t i = base; i < stack_.size(); ++i) {
+            auto &arg = stack_[i];
+            if (Is<Symbol>(arg)) {
+                auto proc = Lookup(*As<Symbol>(arg));
+                if (proc) {
+                    arg = std::make_shared<Procedure>(As<Symbol>(arg)->GetName(), proc->func);
+                }
+            }
+        }
+    }
+}
+
+bool Interpreter::EvaluateBinary(BuiltinKind kind, const std::shared_ptr<Object> &second,
+                                 std::string *out, bool optimizer) {
+    if (kind < BuiltinKind::kAdd || kind > BuiltinKind::kGreaterEq || !Is<Cell>(second)) {
+        return false;
+    }
+    auto cell = static_cast<const Cell *>(second.get());
+    if (!Is<Cell>(cell->GetSecond())) {
+        return false;
+    }
+    auto &lhs = cell->GetFirst();
+    auto rest = static_cast<const Cell *>(cell->GetSecond().get());
+    auto &rhs = rest->GetFirst();
+    if (rest->GetSecond() || !(Is<Number>(lhs) || IsCall(lhs)) || !(Is<Number>(rhs) || IsCall(rhs))) {
+        return false;
+    }
+    auto a = Is<Number>(lhs) ? lhs : EvaluateArg(As<Cell>(lhs), optimizer);
+    auto b = Is<Number>(rhs) ? rhs : EvaluateArg(As<Cell>(rhs), optimizer);
+    if (Is<Number>(a) && Is<Number>(b) &&
+        InvokeBinary(kind, As<Number>(a)->GetValue(), As<Number>(b)->GetValue(), out)) {
+        return true;
+    }
+    stack_.push_back(std::move(a));
+    stack_.push_back(std::move(b));
+    return true;
+}
+
+void Interpreter::Expand(std::shared_ptr<Object> object, std::string *out) {
+    if (!object) {
+        throw RuntimeError();
+    }
+    if (Is<Symbol>(object)) {
+        if (!Lookup(*As<Symbol>(object))) {
+            throw NameError();
+        }
+        throw RuntimeError();
+    }
+    if (!Is<Cell>(object)) {
+        object->Print(out);
+        return;
+    }
+    Evaluate(As<Cell>(object), out);
+}
+
+namespace {
+
+struct YieldAwaiter {
+    AsyncState *state;
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) noexcept {
+        state->resume_point = handle;
+        state->status = AsyncStatus::kReady;
+    }
+
+    void await_resume() const noexcept {
+    }
+};
+
+struct AsyncCallAwaiter {
+    std::shared_ptr<AsyncState> state;
+    IAsyncFunction *func;
+    ArgSpan args;
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        state->resume_point = handle;
+        state->status = AsyncStatus::kWaiting;
+        state->starting = true;
+        try {
+            func->Start(args, [state = state](std::string result, std::exception_ptr error) {
+                state->result = std::move(result);
+                state->error = std::move(error);
+                state->status = AsyncStatus::kReady;
+                if (!state->starting && state->on_ready) {
+                    state->on_ready();
+                }
+            });
+        } catch (...) {
+            state->error = std::current_exception();
+            state->status = AsyncStatus::kReady;
+        }
+        state->starting = false;
+        if (state->status == AsyncStatus::kReady) {
+            state->resume_point = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    std::string await_resume() {
+        if (state->error) {
+            std::rethrow_exception(std::exchange(state->error, nullptr));
+        }
+        return std::exchange(state->result, {});
+    }
+};
+
+}  // namespace
+
+Task<std::shared_ptr<Object>> Interpreter::EvaluateArgAsync(std::shared_ptr<Cell> object,
+                                                            bool optimizer) {
+    std::shared_ptr<Object> res;
+    co_await EvaluateAsync(std::move(object), &scratch_, optimizer, &res);
+    ChargeAllocation(sizeof(Cell));
+    co_return res;
+}
+
+Task<> Interpreter::UnpackArgsAsync(std::shared_ptr<Object> object, bool optimizer) {
+    if (!object) {
+        co_return;
+    }
+    if (!Is<Cell>(object)) {
+        stack_.push_back(object);
+        co_return;
+    }
+    auto obj = As<Cell>(object);
+    while (true) {
+        auto first = obj->GetFirst();
+        if (!first) {
+            stack_.push_back(nullptr);
+            co_return;
+        }
+        if (Is<Cell>(first)) {
+            auto cell = As<Cell>(first);
+            if (cell->GetFirst() && Is<Symbol>(cell->GetFirst())) {
+                auto arg = co_await EvaluateArgAsync(cell, optimizer);
+                stack_.push_back(std::move(arg));
+            } else {
+                if (limits_.max_depth && depth_ >= limits_.max_depth) {
+                    throw LimitError();
+                }
+                ++depth_;
+                co_await UnpackArgsAsync(cell, optimizer);
+                --depth_;
+            }
         } else {
-            UnpackArgs(args, cell, optimizer);
+            stack_.push_back(first);
         }
-    } else {
-        args.push_back(obj->GetSecond());
+        auto second = obj->GetSecond();
+        if (!second) {
+            co_return;
+        }
+        if (!Is<Cell>(second)) {
+            stack_.push_back(second);
+            co_return;
+        }
+        auto cell = As<Cell>(second);
+        if (cell->GetFirst() && Is<Symbol>(cell->GetFirst())) {
+            stack_.push_back(co_await EvaluateArgAsync(cell));
+            co_return;
+        }
+        obj = cell;
     }
 }
 
-std::string Interpreter::Evaluate(std::shared_ptr<Cell> object, bool optimizer) {
+Task<> Interpreter::EvaluateAsync(std::shared_ptr<Cell> object, std::string *out, bool optimizer,
+                                  std::shared_ptr<Object> *value) {
+    Step();
+    if (++yield_count_ >= yield_steps_) {
+        yield_count_ = 0;
+        co_await YieldAwaiter{async_.get()};
+    }
+    if (limits_.max_depth && depth_ >= limits_.max_depth) {
+        throw LimitError();
+    }
     auto first = object->GetFirst();
     if (!first || !Is<Symbol>(first)) {
         throw RuntimeError();
     }
     auto second = object->GetSecond();
     auto symbol = As<Symbol>(first);
-
-    std::vector<std::shared_ptr<Object>> args;
-
-    if (funcs_.find(symbol->GetName()) == funcs_.end()) {
-        if (optimizer) {
-            return symbol->GetName();
-        } else {
+    auto builtin = Lookup(*symbol);
+    if (!builtin) {
+        if (!optimizer) {
             throw NameError();
         }
+        if (value) {
+            *value = first;
+        } else {
+            out->append(symbol->GetName());
+        }
+        co_return;
     }
-    auto func = funcs_[symbol->GetName()];
-    if (symbol->GetName() == "quote") {
-        auto cell = As<Cell>(second);
-        args.push_back(cell->GetFirst());
-        return func->Invoke(args);
+    size_t base = stack_.size();
+    if (builtin->kind == BuiltinKind::kQuote) {
+        stack_.push_back(As<Cell>(second)->GetFirst());
+        CallBuiltin(*builtin->func, base, out, value);
+        co_return;
+    }
+    if (builtin->kind == BuiltinKind::kQuasiquote) {
+        if (!Is<Cell>(second)) {
+            throw RuntimeError();
+        }
+        auto res = Quasiquote(As<Cell>(second)->GetFirst(), 1);
+        if (value) {
+            *value = res ? res : EmptyList();
+        } else {
+            PrintDatum(res.get(), out);
+        }
+        co_return;
     }
-    if (symbol->GetName() == "and" || symbol->GetName() == "or") {
+    if (builtin->kind == BuiltinKind::kAnd || builtin->kind == BuiltinKind::kOr) {
         optimizer = true;
     }
-    UnpackArgs(args, second, optimizer);
-    if (args.size() > 1 && !args.back()) {
-        args.pop_back();
+    ++depth_;
+    co_await UnpackArgsAsync(second, optimizer);
+    --depth_;
+    PrepareArgs(*builtin, base);
+    if (builtin->kind == BuiltinKind::kAsync) {
+        AsyncCallAwaiter call{async_, static_cast<IAsyncFunction *>(builtin->func.get()),
+                              ArgSpan(stack_).subspan(base)};
+        auto result = co_await call;
+        stack_.resize(base);
+        if (value) {
+            ChargeAllocation(result.size());
+            *value = ReadValue(result);
+        } else {
+            out->append(result);
+        }
+    } else {
+        CallBuiltin(*builtin->func, base, out, value);
     }
-    return func->Invoke(args);
 }
 
-std::string Interpreter::Expand(std::shared_ptr<Object> object) {
-    if (!object) {
+Task<> Interpreter::DefinedAsync() {
+    co_return;
+}
+
+Task<> Interpreter::ExpandAsync(std::shared_ptr<Object> object, std::string *out) {
+    if (!Is<Cell>(object)) {
+        Expand(std::move(object), out);
+        co_return;
+    }
+    co_await EvaluateAsync(As<Cell>(object), out);
+}
+
+std::string Interpreter::Run(const std::string &expression) {
+    std::string res;
+    Run(expression, &res);
+    return res;
+}
+
+std::string Interpreter::Run(const std::shared_ptr<Object> &expression) {
+    std::string res;
+    Run(expression, &res);
+    return res;
+}
+
+void Interpreter::Run(const std::string &expression, std::string *out) {
+    if (limits_.max_depth) {
+        CheckNesting(expression);
+    }
+    if (limits_.max_bytes && expression.size() > limits_.max_bytes) {
+        throw LimitError();
+    }
+    StartRun();
+    bool use_memos = UseMemos();
+    if (use_memos) {
+        if (auto memo = FindMemo(expression)) {
+            // Memoized results are plain text and allocate no objects.
+            memo->Run(out);
+            last_run_ = {};
+            return;
+        }
+    }
+    std::shared_ptr<Object> obj;
+    if (macros_) {
+        auto it = expanded_.find(expression);
+        if (it != expanded_.end()) {
+            obj = it->second;
+        }
+    }
+    if (!obj) {
+        std::stringstream exp{expression};
+        Tokenizer tokenizer{&exp};
+        obj = Read(&tokenizer);
+        if (!tokenizer.IsEnd()) {
+            throw SyntaxError();
+        }
+        if (IsForm(obj, "define-syntax")) {
+            DefineSyntax(obj);
+            return;
+        }
+        if (macros_) {
+            obj = ExpandMacros(obj, *macros_, [this] { Step(); });
+            if (expanded_.size() >= kMaxHotExpressions) {
+                expanded_.clear();
+            }
+            expanded_.emplace(expression, obj);
+        }
+    }
+    if (use_memos) {
+        Profile(expression, obj);
+    }
+    Execute(obj, out);
+}
+
+void Interpreter::Run(const std::shared_ptr<Object> &expression, std::string *out) {
+    if (IsForm(expression, "define-syntax")) {
+        DefineSyntax(expression);
+        return;
+    }
+    StartRun();
+    Execute(macros_ ? ExpandCached(expression) : expression, out);
+}
+
+// Starts the step count of a blocking run. Macro expansion and evaluation are charged against the
+// same limits.
+void Interpreter::StartRun() {
+    if (async_) {
         throw RuntimeError();
     }
-    if (Is<Number>(object)) {
-        return std::to_string(As<Number>(object)->GetValue());
+    steps_ = 0;
+    depth_ = 0;
+    quantum_ = 0;
+    budget_ = 0;
+}
+
+std::shared_ptr<Object> Interpreter::ExpandCached(const std::shared_ptr<Object> &expression) {
+    // Entries are keyed by address and hold the source weakly, so the cache never keeps a caller's
+    // expression alive. A live source proves the address was not reused by another expression.
+    auto it = expanded_objects_.find(expression.get());
+    if (it != expanded_objects_.end() && !it->second.source.expired()) {
+        return it->second.expansion;
     }
-    if (Is<Bool>(object)) {
-        return (As<Bool>(object)->GetBool()) ? "#t" : "#f";
+    auto res = ExpandMacros(expression, *macros_, [this] { Step(); });
+    if (expanded_objects_.size() >= kMaxHotExpressions) {
+        expanded_objects_.clear();
     }
-    if (Is<Symbol>(object)) {
-        auto symbol = As<Symbol>(object);
-        if (funcs_.find(symbol->GetName()) == funcs_.end()) {
+    expanded_objects_.insert_or_assign(expression.get(), ExpandedObject{expression, res});
+    return res;
+}
+
+void Interpreter::DefineSyntax(const std::shared_ptr<Object> &form) {
+    std::vector<std::shared_ptr<Object>> items;
+    std::shared_ptr<Object> tail;
+    ListElements(form, &items, &tail);
+    if (items.size() != 3 || tail || !Is<Symbol>(items[1])) {
+        throw SyntaxError();
+    }
+    auto macros = macros_ ? std::make_shared<MacroTable>(*macros_) : std::make_shared<MacroTable>();
+    macros->insert_or_assign(As<Symbol>(items[1])->GetName(), SyntaxRules(items[2]));
+    macros_ = std::move(macros);
+    expanded_.clear();
+    expanded_objects_.clear();
+    hot_.clear();
+    memos_ = nullptr;
+}
+
+std::shared_ptr<Object> Interpreter::Unquote(const std::shared_ptr<Object> &operand) {
+    if (IsCall(operand)) {
+        return EvaluateArg(As<Cell>(operand));
+    }
+    if (Is<Symbol>(operand)) {
+        if (!Lookup(*As<Symbol>(operand))) {
             throw NameError();
         }
         throw RuntimeError();
     }
-    return Evaluate(As<Cell>(object));
+    if (Is<Cell>(operand)) {
+        throw RuntimeError();
+    }
+    return operand;
 }
 
-std::string Interpreter::Run(const std::string &expression) {
+std::shared_ptr<Object> Interpreter::Quasiquote(const std::shared_ptr<Object> &form, size_t depth) {
+    if (Is<Vector>(form)) {
+        // A vector template is filled in like the list of its items.
+        auto list = RebuildList(As<Vector>(form)->GetItems(), nullptr);
+        auto res = Quasiquote(list, depth);
+        if (res == list) {
+            return form;
+        }
+        std::vector<std::shared_ptr<Object>> items;
+        std::shared_ptr<Object> tail;
+        ListElements(res, &items, &tail);
+        if (tail) {
+            throw RuntimeError();
+        }
+        return std::make_shared<Vector>(std::move(items));
+    }
+    if (!Is<Cell>(form)) {
+        return form;
+    }
+    auto cell = As<Cell>(form);
+    if (IsForm(form, "unquote") || IsForm(form, "quasiquote")) {
+        auto operand = As<Cell>(cell->GetSecond())->GetFirst();
+        bool unquote = As<Symbol>(cell->GetFirst())->GetName() == "unquote";
+        if (unquote && depth == 1) {
+            return Unquote(operand);
+        }
+        return RebuildList({cell->GetFirst(), Quasiquote(operand, unquote ? depth - 1 : depth + 1)},
+                           nullptr);
+    }
+    std::vector<std::shared_ptr<Object>> items;
+    std::shared_ptr<Object> cur = form;
+    bool changed = false;
+    while (Is<Cell>(cur)) {
+        auto &item = static_cast<const Cell *>(cur.get())->GetFirst();
+        if (depth == 1 && IsForm(item, "unquote-splicing")) {
+            auto value = Unquote(As<Cell>(As<Cell>(item)->GetSecond())->GetFirst());
+            std::shared_ptr<Object> tail;
+            if (!IsEmptyList(value)) {
+                ListElements(value, &items, &tail);
+            }
+            if (tail) {
+                throw RuntimeError();
+            }
+            changed = true;
+        } else {
+            items.push_back(Quasiquote(item, depth));
+            changed |= items.back() != item;
+        }
+        cur = static_cast<const Cell *>(cur.get())->GetSecond();
+        if (depth == 1 && IsForm(cur, "unquote")) {
+            cur = Unquote(As<Cell>(As<Cell>(cur)->GetSecond())->GetFirst());
+            if (IsEmptyList(cur)) {
+                cur = nullptr;
+            }
+            changed = true;
+            break;
+        }
+    }
+    return changed ? RebuildList(items, cur) : form;
+}
+
+void Interpreter::Execute(const std::shared_ptr<Object> &expression, std::string *out) {
+    if (async_) {
+        throw RuntimeError();
+    }
+    size_t mark = out->size();
+    scratch_.clear();
+    stack_.clear();
+    bytes_left_ = limits_.max_bytes;
+    // A builtin may run another interpreter on this thread, so the byte and step budgets of the
+    // outer run are put back rather than cleared.
+    auto budget = SetAllocationBudget(limits_.max_bytes ? &bytes_left_ : nullptr);
+    StepCounter steps{&budget_, [this] { CheckLimits(); }};
+    auto counter = SetStepCounter(&steps);
+    auto before = ThreadAllocations();
+    auto finish = [this, &before, budget, counter] {
+        SetAllocationBudget(budget);
+        SetStepCounter(counter);
+        auto after = ThreadAllocations();
+        last_run_ = {after.objects - before.objects, after.bytes - before.bytes};
+    };
+    try {
+        Step();
+        Expand(expression, out);
+    } catch (...) {
+        finish();
+        out->resize(mark);
+        throw;
+    }
+    finish();
+}
+
+AllocationTotals Interpreter::GetLastRunAllocations() const {
+    return last_run_;
+}
+
+void Interpreter::RunRow(const std::shared_ptr<Object> &expression, const ColumnMap &columns,
+                         size_t row, BatchResult *res) {
+    auto value = ReadValue(Run(BindRow(expression, columns, row)));
+    if (res->is_predicate && Is<Bool>(value)) {
+        if (As<Bool>(value)->GetBool()) {
+            res->selection[row / 64] |= uint64_t{1} << (row % 64);
+        }
+    } else if (!res->is_predicate && Is<Number>(value)) {
+        res->values[row] = As<Number>(value)->GetValue();
+    } else {
+        throw RuntimeError();
+    }
+}
+
+BatchResult Interpreter::RunBatch(const std::string &expression, const ColumnMap &columns,
+                                  size_t rows) {
+    for (auto &[name, column] : columns) {
+        if (column.size() < rows) {
+            throw RuntimeError();
+        }
+    }
+    std::stringstream exp{expression};
+    Tokenizer tokenizer{&exp};
+    auto obj = Read(&tokenizer);
+    if (!tokenizer.IsEnd()) {
+        throw SyntaxError();
+    }
+    BatchResult res;
+    auto program = BatchProgram::Compile(obj, *funcs_, columns);
+    if (program) {
+        res.is_predicate = program->IsPredicate();
+    } else if (rows) {
+        res.is_predicate = Is<Bool>(ReadValue(Run(BindRow(obj, columns, 0))));
+    }
+    if (res.is_predicate) {
+        res.selection.resize((rows + 63) / 64);
+    } else {
+        res.values.resize(rows);
+    }
+    std::vector<int64_t> block(program ? kBatchSize : 0);
+    for (size_t from = 0; from < rows; from += kBatchSize) {
+        size_t count = std::min(kBatchSize, rows - from);
+        if (!program || !program->Evaluate(from, count, block.data())) {
+            for (size_t row = from; row < from + count; ++row) {
+                RunRow(obj, columns, row, &res);
+            }
+            continue;
+        }
+        if (!res.is_predicate) {
+            std::copy(block.begin(), block.begin() + count, res.values.begin() + from);
+            continue;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            size_t row = from + i;
+            res.selection[row / 64] |= static_cast<uint64_t>(block[i]) << (row % 64);
+        }
+    }
+    return res;
+}
+
+Evaluation Interpreter::RunAsync(const std::string &expression, size_t yield_steps) {
+    if (limits_.max_depth) {
+        CheckNesting(expression);
+    }
+    if (limits_.max_bytes && expression.size() > limits_.max_bytes) {
+        throw LimitError();
+    }
     std::stringstream exp{expression};
     Tokenizer tokenizer{&exp};
     auto obj = Read(&tokenizer);
     if (!tokenizer.IsEnd()) {
         throw SyntaxError();
     }
-    return Expand(obj);
-}
\ No newline at end of file
+    return RunAsync(obj, yield_steps);
+}
+
+Evaluation Interpreter::RunAsync(const std::shared_ptr<Object> &expression, size_t yield_steps) {
+    StartRun();
+    bool definition = IsForm(expression, "define-syntax");
+    if (definition) {
+        DefineSyntax(expression);
+    }
+    // Expanded before the evaluation is installed, so an expansion error leaves none behind.
+    auto expanded = !definition && macros_ ? ExpandCached(expression) : expression;
+    scratch_.clear();
+    stack_.clear();
+    bytes_left_ = limits_.max_bytes;
+    yield_steps_ = std::max<size_t>(yield_steps, 1);
+    yield_count_ = 0;
+    async_ = std::make_shared<AsyncState>();
+    auto root = definition ? DefinedAsync() : ExpandAsync(expanded, &async_->output);
+    async_->resume_point = root.GetHandle();
+    return Evaluation(this, async_, std::move(root));
+}
+
+void Interpreter::Register(const std::string &name, std::shared_ptr<IFunction> func) {
+    size_t slot = FunctionSlot(name);
+    auto funcs = std::make_shared<FunctionTable>(*funcs_);
+    if (funcs->size() <= slot) {
+        funcs->resize(slot + 1);
+    }
+    auto kind = GetBuiltinKind(func.get());
+    (*funcs)[slot] = Builtin{std::move(func), kind};
+    funcs_ = std::move(funcs);
+    hot_.clear();
+    memos_ = nullptr;
+}
+
+Evaluation::Evaluation(Interpreter *interpreter, std::shared_ptr<AsyncState> state, Task<> root)
+    : interpreter_(interpreter), state_(std::move(state)), root_(std::move(root)) {
+}
+
+Evaluation::~Evaluation() {
+    if (!state_) {
+        return;
+    }
+    state_->on_ready = nullptr;
+    if (interpreter_->async_ == state_) {
+        interpreter_->async_ = nullptr;
+    }
+}
+
+AsyncStatus Evaluation::Resume() {
+    if (state_->status != AsyncStatus::kReady) {
+        return state_->status;
+    }
+    auto &self = *interpreter_;
+    auto budget = SetAllocationBudget(self.limits_.max_bytes ? &self.bytes_left_ : nullptr);
+    StepCounter steps{&self.budget_, [&self] { self.CheckLimits(); }};
+    auto counter = SetStepCounter(&steps);
+    std::exchange(state_->resume_point, nullptr).resume();
+    SetAllocationBudget(budget);
+    SetStepCounter(counter);
+    auto handle = root_.GetHandle();
+    if (handle.done()) {
+        state_->status = AsyncStatus::kDone;
+        state_->error = handle.promise().error;
+        if (state_->error) {
+            state_->output.clear();
+        }
+        self.async_ = nullptr;
+    }
+    return state_->status;
+}
+
+AsyncStatus Evaluation::GetStatus() const {
+    return state_->status;
+}
+
+void Evaluation::SetOnReady(std::function<void()> on_ready) {
+    state_->on_ready = std::move(on_ready);
+}
+
+std::string Evaluation::TakeResult() {
+    if (state_->status != AsyncStatus::kDone) {
+        throw RuntimeError();
+    }
+    if (state_->error) {
+        std::rethrow_exception(state_->error);
+    }
+    return std::move(state_->output);
+}
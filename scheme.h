@@ -1,22 +1,169 @@
 #pragma once
 
+#include "async.h"
+#include "batch.h"
+#include "memo.h"
 #include "functions.h"
+#include "macro.h"
 #include "object.h"
 
-#include <map>
+#include <atomic>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+class CancellationToken {
+public:
+    void Cancel() {
+        cancelled_.store(true, std::memory_order_relaxed);
+    }
+
+    bool IsCancelled() const {
+        return cancelled_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<bool> cancelled_ = false;
+};
+
+struct EvalLimits {
+    size_t max_steps = 0;
+    size_t max_depth = 0;
+    size_t max_bytes = 0;
+    const CancellationToken* cancel = nullptr;
+};
+
+using MemoTable = std::unordered_map<std::string, std::shared_ptr<const MemoizedResult>>;
+
+// Frozen interpreter state: the builtin table, including registered definitions, the macros and
+// the memoized results of hot constant expressions. Interpreters built from a snapshot share it
+// and copy a part only when they change it. The limits carry no cancellation token, which belongs
+// to the run that set it; a child that needs one sets its own.
+struct InterpreterSnapshot {
+    std::shared_ptr<const FunctionTable> funcs;
+    std::shared_ptr<const MemoTable> memos;
+    std::shared_ptr<const MacroTable> macros;
+    EvalLimits limits;
+    size_t memo_threshold = 0;
+};
+
+class Interpreter;
+
+// An evaluation started by Interpreter::RunAsync. Resume runs it until it finishes, uses up its
+// step slice or waits on an async builtin; in the last case on_ready fires once the builtin
+// completes. The interpreter must outlive the evaluation and runs nothing else meanwhile.
+class Evaluation {
+public:
+    Evaluation(Evaluation&&) noexcept = default;
+    ~Evaluation();
+    AsyncStatus Resume();
+    AsyncStatus GetStatus() const;
+    void SetOnReady(std::function<void()> on_ready);
+    std::string TakeResult();
+
+private:
+    friend class Interpreter;
+    Evaluation(Interpreter* interpreter, std::shared_ptr<AsyncState> state, Task<> root);
+
+    Interpreter* interpreter_;
+    std::shared_ptr<AsyncState> state_;
+    Task<> root_;
+};
 
 class Interpreter {
 public:
     Interpreter();
+    explicit Interpreter(const InterpreterSnapshot& snapshot);
+    InterpreterSnapshot Snapshot() const;
     std::string Run(const std::string& expression);
+    std::string Run(const std::shared_ptr<Object>& expression);
+    void Run(const std::string& expression, std::string* out);
+    void Run(const std::shared_ptr<Object>& expression, std::string* out);
+    void SetLimits(const EvalLimits& limits);
+    void SetMemoThreshold(size_t threshold);
+    AllocationTotals GetLastRunAllocations() const;
+    BatchResult RunBatch(const std::string& expression, const ColumnMap& columns, size_t rows);
+    Evaluation RunAsync(const std::string& expression, size_t yield_steps = 1024);
+    Evaluation RunAsync(const std::shared_ptr<Object>& expression, size_t yield_steps = 1024);
+    void Register(const std::string& name, std::shared_ptr<IFunction> func);
+
+    template <class F>
+        requires(!std::is_convertible_v<F, std::shared_ptr<IFunction>>)
+    void Register(const std::string& name, F func) {
+        Register(name, MakeFunction(std::move(func)));
+    }
+
+    template <FixedString Name, class F>
+    void Register(F func) {
+        Register(Name.value, MakeFunction(std::move(func)));
+    }
 
 private:
-    std::string Expand(std::shared_ptr<Object> object);
-    std::string Evaluate(std::shared_ptr<Cell> object, bool optimizer = false);
+    friend class Evaluation;
+
+    void StartRun();
+    void Execute(const std::shared_ptr<Object>& expression, std::string* out);
+    void DefineSyntax(const std::shared_ptr<Object>& form);
+    std::shared_ptr<Object> ExpandCached(const std::shared_ptr<Object>& expression);
+    std::shared_ptr<Object> Quasiquote(const std::shared_ptr<Object>& form, size_t depth);
+    std::shared_ptr<Object> Unquote(const std::shared_ptr<Object>& operand);
+    void Expand(std::shared_ptr<Object> object, std::string* out);
+    // With value set, the result is stored there as an object instead of printed to out.
+    void Evaluate(std::shared_ptr<Cell> object, std::string* out, bool optimizer = false,
+                  std::shared_ptr<Object>* value = nullptr);
+    void EvaluateCall(std::shared_ptr<Cell> object, std::string* out, bool optimizer,
+                      std::shared_ptr<Object>* value);
+    void CallBuiltin(IFunction& func, size_t base, std::string* out,
+                     std::shared_ptr<Object>* value);
+    bool EvaluateBinary(BuiltinKind kind, const std::shared_ptr<Object>& second, std::string* out,
+                        bool optimizer);
+    const Builtin* Lookup(const Symbol& symbol) const;
+    std::shared_ptr<Object> EvaluateArg(std::shared_ptr<Cell> object, bool optimizer = false);
     void UnpackArgs(std::vector<std::shared_ptr<Object>>& args, std::shared_ptr<Object> obj,
                     bool optimizer = false);
-    std::shared_ptr<Object> CheckString(const std::string& obj);
-    std::map<std::string, std::shared_ptr<IFunction>> funcs_;
+    void PrepareArgs(const Builtin& builtin, size_t base);
+    Task<> DefinedAsync();
+    Task<> ExpandAsync(std::shared_ptr<Object> object, std::string* out);
+    Task<> EvaluateAsync(std::shared_ptr<Cell> object, std::string* out, bool optimizer = false,
+                         std::shared_ptr<Object>* value = nullptr);
+    Task<std::shared_ptr<Object>> EvaluateArgAsync(std::shared_ptr<Cell> object,
+                                                   bool optimizer = false);
+    Task<> UnpackArgsAsync(std::shared_ptr<Object> object, bool optimizer = false);
+    struct HotExpression {
+        size_t count = 0;
+        std::shared_ptr<const MemoizedResult> memo;
+    };
+
+    bool UseMemos() const;
+    const MemoizedResult* FindMemo(const std::string& expression) const;
+    void Profile(const std::string& expression, const std::shared_ptr<Object>& obj);
+    void Step();
+    void CheckLimits();
+    void CheckNesting(const std::string& expression);
+    void RunRow(const std::shared_ptr<Object>& expression, const ColumnMap& columns, size_t row,
+                BatchResult* res);
+    std::shared_ptr<const FunctionTable> funcs_;
+    std::string scratch_;
+    std::vector<std::shared_ptr<Object>> stack_;
+    EvalLimits limits_;
+    int64_t budget_ = 0;
+    int64_t quantum_ = 0;
+    size_t steps_ = 0;
+    size_t depth_ = 0;
+    int64_t bytes_left_ = 0;
+    size_t memo_threshold_ = 16;
+    std::unordered_map<std::string, HotExpression> hot_;
+    std::shared_ptr<const MemoTable> memos_;
+    std::shared_ptr<const MacroTable> macros_;
+    std::unordered_map<std::string, std::shared_ptr<Object>> expanded_;
+    struct ExpandedObject {
+        std::weak_ptr<Object> source;
+        std::shared_ptr<Object> expansion;
+    };
+    std::unordered_map<const Object*, ExpandedObject> expanded_objects_;
+    std::shared_ptr<AsyncState> async_;
+    AllocationTotals last_run_;
+    size_t yield_steps_ = 0;
+    size_t yield_count_ = 0;
 };
\ No newline at end of file
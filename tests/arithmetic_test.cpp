@@ -0,0 +1,53 @@
+#include "error.h"
+#include "scheme.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+namespace {
+
+const std::string kMax = "9223372036854775807";
+const std::string kMin = "(- -9223372036854775807 1)";
+
+}  // namespace
+
+TEST(Arithmetic, Limits) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(+ " + kMax + " 0)"), kMax);
+    EXPECT_EQ(interpreter.Run(kMin), "-9223372036854775808");
+    EXPECT_EQ(interpreter.Run("(- " + kMin + " -1)"), "-9223372036854775807");
+    EXPECT_EQ(interpreter.Run("(* " + kMin + " 1)"), "-9223372036854775808");
+    EXPECT_EQ(interpreter.Run("(abs -" + kMax + ")"), kMax);
+}
+
+TEST(Arithmetic, OverflowRaisesRuntimeError) {
+    Interpreter interpreter;
+    for (std::string expression : {
+             "(+ " + kMax + " 1)",
+             "(+ 1 2 " + kMax + ")",
+             "(- " + kMin + " 1)",
+             "(- 0 " + kMin + ")",
+             "(* " + kMax + " 2)",
+             "(* " + kMin + " -1)",
+             "(/ " + kMin + " -1)",
+             "(abs " + kMin + ")",
+         }) {
+        EXPECT_THROW(interpreter.Run(expression), RuntimeError) << expression;
+    }
+}
+
+TEST(Arithmetic, OverflowInNestedCall) {
+    Interpreter interpreter;
+    EXPECT_THROW(interpreter.Run("(max 1 (+ " + kMax + " 1))"), RuntimeError);
+    EXPECT_EQ(interpreter.Run("(+ 1 2)"), "3");
+}
+
+TEST(Arithmetic, OverflowIsNotMemoized) {
+    Interpreter interpreter;
+    interpreter.SetMemoThreshold(1);
+    std::string expression = "(* (+ " + kMax + " 0) 2)";
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_THROW(interpreter.Run(expression), RuntimeError);
+    }
+}
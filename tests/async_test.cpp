@@ -0,0 +1,132 @@
+#include "error.h"
+#include "parser.h"
+#include "scheme.h"
+#include "tokenizer.h"
+
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Single-threaded event loop: async builtins post their completions, the test drains them.
+struct EventLoop {
+    void Drain() {
+        while (!posted.empty()) {
+            auto callback = std::move(posted.front());
+            posted.pop_front();
+            callback();
+        }
+    }
+
+    std::deque<std::function<void()>> posted;
+};
+
+// Completes with its argument on the next turn of the loop.
+class Later : public IAsyncFunction {
+public:
+    explicit Later(EventLoop* loop) : loop_(loop) {
+    }
+
+    void Start(ArgSpan args, AsyncCallback done) override {
+        std::string value = args.empty() ? "0" : args[0]->ToString();
+        loop_->posted.push_back([value, done] { done(value, nullptr); });
+    }
+
+private:
+    EventLoop* loop_;
+};
+
+std::string Finish(Evaluation* evaluation, EventLoop* loop) {
+    while (true) {
+        auto status = evaluation->Resume();
+        if (status == AsyncStatus::kDone) {
+            return evaluation->TakeResult();
+        }
+        if (status == AsyncStatus::kWaiting) {
+            loop->Drain();
+        }
+    }
+}
+
+}  // namespace
+
+TEST(Async, WaitsOnAsyncBuiltin) {
+    EventLoop loop;
+    Interpreter interpreter;
+    interpreter.Register("later", std::make_shared<Later>(&loop));
+    auto evaluation = interpreter.RunAsync("(+ 1 (later 2) (* 3 4))");
+    EXPECT_EQ(evaluation.Resume(), AsyncStatus::kWaiting);
+    EXPECT_EQ(Finish(&evaluation, &loop), "15");
+    EXPECT_EQ(interpreter.Run("(+ 1 2)"), "3");
+}
+
+TEST(Async, InterleavesSlicedEvaluations) {
+    std::string large = "(+";
+    for (int i = 0; i < 5000; ++i) {
+        large += " (* " + std::to_string(i % 100) + " 2)";
+    }
+    large += ")";
+    std::stringstream in{large};
+    Tokenizer tokenizer{&in};
+    auto large_obj = Read(&tokenizer);
+
+    EventLoop loop;
+    std::vector<std::unique_ptr<Interpreter>> interpreters;
+    std::vector<Evaluation> evaluations;
+    for (int i = 0; i < 8; ++i) {
+        interpreters.push_back(std::make_unique<Interpreter>());
+        interpreters.back()->Register("later", std::make_shared<Later>(&loop));
+        evaluations.push_back(i == 3 ? interpreters.back()->RunAsync(large_obj, 256)
+                                     : interpreters.back()->RunAsync("(+ 1 (later 2) (* 3 4))", 256));
+    }
+    std::vector<std::string> results(evaluations.size());
+    size_t done = 0;
+    size_t rounds = 0;
+    while (done < evaluations.size()) {
+        ++rounds;
+        for (size_t i = 0; i < evaluations.size(); ++i) {
+            if (results[i].empty() && evaluations[i].Resume() == AsyncStatus::kDone) {
+                results[i] = evaluations[i].TakeResult();
+                ++done;
+            }
+        }
+        loop.Drain();
+    }
+    EXPECT_GT(rounds, 2u);
+    for (size_t i = 0; i < results.size(); ++i) {
+        EXPECT_EQ(results[i], i == 3 ? "495000" : "15");
+    }
+}
+
+TEST(Async, RunIsRejectedWhileEvaluationIsPending) {
+    EventLoop loop;
+    Interpreter interpreter;
+    interpreter.Register("later", std::make_shared<Later>(&loop));
+    interpreter.SetMemoThreshold(1);
+    std::string hot = "(+ 1 2)";
+    EXPECT_EQ(interpreter.Run(hot), "3");
+    EXPECT_EQ(interpreter.Run(hot), "3");
+
+    auto evaluation = interpreter.RunAsync("(later 5)");
+    EXPECT_EQ(evaluation.Resume(), AsyncStatus::kWaiting);
+    EXPECT_THROW(interpreter.Run(hot), RuntimeError);
+    EXPECT_THROW(interpreter.Run("(* 2 3)"), RuntimeError);
+    EXPECT_EQ(Finish(&evaluation, &loop), "5");
+    EXPECT_EQ(interpreter.Run(hot), "3");
+}
+
+TEST(Async, MemoizedRunResetsLastRunAllocations) {
+    Interpreter interpreter;
+    interpreter.SetMemoThreshold(1);
+    std::string hot = "(* (+ 1 2) 3)";
+    interpreter.Run(hot);
+    interpreter.Run("(make-vector 64 1)");
+    EXPECT_EQ(interpreter.Run(hot), "9");
+    EXPECT_EQ(interpreter.GetLastRunAllocations().objects, 0u);
+}
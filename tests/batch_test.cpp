@@ -0,0 +1,76 @@
+#include "parser.h"
+#include "scheme.h"
+#include "tokenizer.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<int64_t> Column(size_t rows) {
+    std::vector<int64_t> column(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        column[i] = static_cast<int64_t>(i) - 3;
+    }
+    return column;
+}
+
+// Evaluates expression row by row through the interpreter.
+std::vector<int64_t> Interpret(const std::string& expression, const ColumnMap& columns,
+                               size_t rows) {
+    std::stringstream in{expression};
+    Tokenizer tokenizer{&in};
+    auto obj = Read(&tokenizer);
+    Interpreter interpreter;
+    std::vector<int64_t> res;
+    for (size_t row = 0; row < rows; ++row) {
+        auto out = interpreter.Run(BindRow(obj, columns, row));
+        res.push_back(out == "#t" ? 1 : out == "#f" ? 0 : std::stoll(out));
+    }
+    return res;
+}
+
+std::vector<int64_t> Selected(const BatchResult& res, size_t rows) {
+    std::vector<int64_t> values;
+    for (size_t row = 0; row < rows; ++row) {
+        values.push_back((res.selection[row / 64] >> (row % 64)) & 1);
+    }
+    return values;
+}
+
+}  // namespace
+
+TEST(Batch, Arithmetic) {
+    auto x = Column(2000);
+    Interpreter interpreter;
+    auto res = interpreter.RunBatch("(+ (* x 2) 1)", {{"x", x}}, x.size());
+    ASSERT_FALSE(res.is_predicate);
+    for (size_t i = 0; i < x.size(); ++i) {
+        EXPECT_EQ(res.values[i], x[i] * 2 + 1);
+    }
+}
+
+TEST(Batch, NestedZeroArgumentCalls) {
+    auto x = Column(2000);
+    Interpreter interpreter;
+    for (std::string expression : {"(* x (*))", "(+ (+) x (*))", "(- x (+ (*) (+)))"}) {
+        auto res = interpreter.RunBatch(expression, {{"x", x}}, x.size());
+        ASSERT_FALSE(res.is_predicate) << expression;
+        EXPECT_EQ(res.values, Interpret(expression, {{"x", x}}, x.size())) << expression;
+    }
+    for (std::string expression : {"(and (> x 1) (and))", "(or (or) (< x 0) (and))"}) {
+        auto res = interpreter.RunBatch(expression, {{"x", x}}, x.size());
+        ASSERT_TRUE(res.is_predicate) << expression;
+        EXPECT_EQ(Selected(res, x.size()), Interpret(expression, {{"x", x}}, x.size())) << expression;
+    }
+}
+
+TEST(Batch, OverflowRaisesRuntimeError) {
+    std::vector<int64_t> x = {1, INT64_MAX};
+    Interpreter interpreter;
+    EXPECT_THROW(interpreter.RunBatch("(+ x 1)", {{"x", x}}, x.size()), RuntimeError);
+    EXPECT_THROW(interpreter.RunBatch("(/ (- 0 x 1) -1)", {{"x", x}}, x.size()), RuntimeError);
+}
@@ -0,0 +1,89 @@
+#include "error.h"
+#include "functions.h"
+#include "hashcons.h"
+#include "parser.h"
+#include "scheme.h"
+#include "tokenizer.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+TEST(Flonum, Arithmetic) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(+ 1 2.5)"), "3.5");
+    EXPECT_EQ(interpreter.Run("(* 2 0.5)"), "1.0");
+    EXPECT_EQ(interpreter.Run("(/ 1.0 4)"), "0.25");
+    EXPECT_EQ(interpreter.Run("(< 1 1.5 2)"), "#t");
+    EXPECT_EQ(interpreter.Run("(abs -2.5)"), "2.5");
+    EXPECT_EQ(interpreter.Run("(number? 0.1)"), "#t");
+}
+
+TEST(Flonum, Lists) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(list 1.5 2)"), "(1.5 2)");
+    EXPECT_EQ(interpreter.Run("(cons 1 2.5)"), "(1 . 2.5)");
+    EXPECT_EQ(interpreter.Run("'(1 . 2.5)"), "(1 . 2.5)");
+    EXPECT_EQ(interpreter.Run("(car (list 1.5 2))"), "1.5");
+    EXPECT_EQ(interpreter.Run("(cdr (cons 1 2.5))"), "2.5");
+    EXPECT_EQ(interpreter.Run("(map abs '(-1.5 2))"), "(1.5 2)");
+    EXPECT_EQ(interpreter.Run("(apply + (list 1 2.5))"), "3.5");
+    EXPECT_EQ(interpreter.Run("(length (list 0.5 1.5 2.5))"), "3");
+    EXPECT_THROW(interpreter.Run("(list 1.5 'a)"), RuntimeError);
+}
+
+TEST(Flonum, HashConsing) {
+    std::stringstream in{"(1.5 1.5 2.5 0.0 -0.0 1.5)"};
+    Tokenizer tokenizer{&in};
+    HashConsTable table;
+    auto list = Read(&tokenizer, &table);
+    std::vector<const Object*> items;
+    for (auto cur = list; cur; cur = As<Cell>(cur)->GetSecond()) {
+        items.push_back(As<Cell>(cur)->GetFirst().get());
+    }
+    ASSERT_EQ(items.size(), 6u);
+    EXPECT_EQ(items[0], items[1]);
+    EXPECT_EQ(items[0], items[5]);
+    EXPECT_NE(items[0], items[2]);
+    EXPECT_NE(items[3], items[4]);
+    EXPECT_GT(table.GetStats().bytes_saved, 0u);
+}
+
+TEST(Flonum, NaNIsNotEqualToItself) {
+    std::stringstream in{"(+nan.0 +nan.0)"};
+    Tokenizer tokenizer{&in};
+    HashConsTable table;
+    auto list = Read(&tokenizer, &table);
+    std::vector<std::shared_ptr<Object>> args{As<Cell>(list)->GetFirst(),
+                                              As<Cell>(As<Cell>(list)->GetSecond())->GetFirst()};
+    ASSERT_EQ(args[0], args[1]);
+    EXPECT_EQ(EqFunction{}.Invoke(args), "#f");
+    EXPECT_EQ(LEqFunction{}.Invoke(args), "#f");
+
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(= +nan.0 +nan.0)"), "#f");
+    EXPECT_EQ(interpreter.Run("(< 1 +nan.0)"), "#f");
+    EXPECT_EQ(interpreter.Run("(>= +nan.0 1)"), "#f");
+}
+
+TEST(Flonum, MixedComparisonIsExact) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(= 9007199254740993 9007199254740992.0)"), "#f");
+    EXPECT_EQ(interpreter.Run("(> 9007199254740993 9007199254740992.0)"), "#t");
+    EXPECT_EQ(interpreter.Run("(< 9007199254740992.0 9007199254740993)"), "#t");
+    EXPECT_EQ(interpreter.Run("(= 2 2.0)"), "#t");
+    EXPECT_EQ(interpreter.Run("(< -3 -2.5 -2)"), "#t");
+    EXPECT_EQ(interpreter.Run("(< 9223372036854775807 9223372036854775808.0)"), "#t");
+    EXPECT_EQ(interpreter.Run("(> -9223372036854775808 -1e19)"), "#t");
+    EXPECT_EQ(interpreter.Run("(< 1 +inf.0)"), "#t");
+}
+
+TEST(Flonum, LeadingDot) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run(".5"), "0.5");
+    EXPECT_EQ(interpreter.Run("-.5"), "-0.5");
+    EXPECT_EQ(interpreter.Run("+.25"), "0.25");
+    EXPECT_EQ(interpreter.Run("(+ .5 1)"), "1.5");
+    EXPECT_EQ(interpreter.Run("'(1 . 2)"), "(1 . 2)");
+    EXPECT_EQ(interpreter.Run("(- 3 1)"), "2");
+}
@@ -0,0 +1,82 @@
+#include "error.h"
+#include "functions.h"
+#include "hashtable.h"
+#include "parser.h"
+#include "scheme.h"
+#include "tokenizer.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+
+TEST(HashTable, AlistPairs) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(alist->hash-table '((a . 1) (b . 2)))"), "#hash((a . 1) (b . 2))");
+    EXPECT_EQ(interpreter.Run("(hash-ref (alist->hash-table '((a 1 2) (b . 2))) 'a)"), "(1 2)");
+    EXPECT_EQ(interpreter.Run("(hash-ref (alist->hash-table '((a 1 2) (b . 2))) 'b)"), "2");
+    EXPECT_EQ(interpreter.Run("(hash-count (alist->hash-table '((1 . 2) (1 . 3) (x . 4))))"), "2");
+    EXPECT_EQ(interpreter.Run("(hash-count (alist->hash-table '()))"), "0");
+    EXPECT_THROW(interpreter.Run("(alist->hash-table '(1 2))"), RuntimeError);
+    EXPECT_THROW(interpreter.Run("(alist->hash-table '(((1) . 2)))"), RuntimeError);
+}
+
+TEST(HashTable, RefAndSet) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(hash-ref (hash-set! (make-hash-table) 'k 7) 'k)"), "7");
+    EXPECT_EQ(interpreter.Run("(hash-ref (hash-set! (make-hash-table) 3 'v) 3)"), "v");
+    EXPECT_EQ(interpreter.Run("(hash-ref (make-hash-table) 'never-inserted 0)"), "0");
+    EXPECT_THROW(interpreter.Run("(hash-ref (make-hash-table) 'never-inserted)"), RuntimeError);
+}
+
+TEST(HashTable, KeysDoNotTakeBuiltinSlots) {
+    Interpreter interpreter;
+    interpreter.Run("(hash-set! (make-hash-table) 'hash-key-only-name 1)");
+    EXPECT_EQ(FindFunctionSlot("hash-key-only-name"), -1);
+    // A key that names a builtin still resolves to the same entry.
+    EXPECT_EQ(interpreter.Run("(hash-ref (hash-set! (make-hash-table) 'car 1) 'car)"), "1");
+    EXPECT_EQ(interpreter.Run("(car '(5 6))"), "5");
+}
+
+TEST(HashTable, NestedValues) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(hash-ref (alist->hash-table '((a (1 2) (3 4)))) 'a)"),
+              "((1 2) (3 4))");
+    EXPECT_EQ(interpreter.Run("(car (hash-ref (alist->hash-table '((a (1 2) 3))) 'a))"), "(1 2)");
+    EXPECT_EQ(interpreter.Run("(alist->hash-table '((a (1 2))))"), "#hash((a . ((1 2))))");
+    EXPECT_EQ(interpreter.Run("(hash-ref (hash-set! (make-hash-table) 'k (list 1 2)) 'k)"), "(1 2)");
+}
+
+TEST(HashTable, InvalidKeysAreRejectedOnEmptyTables) {
+    Interpreter interpreter;
+    EXPECT_THROW(interpreter.Run("(hash-ref (make-hash-table) \"s\" 7)"), RuntimeError);
+    EXPECT_THROW(interpreter.Run("(hash-ref (make-hash-table) 1.5 7)"), RuntimeError);
+    EXPECT_THROW(HashTable{}.Find(std::make_shared<String>("s")), RuntimeError);
+}
+
+TEST(HashTable, SymbolKeysCompareByName) {
+    HashTable table;
+    for (int i = 0; i < 1000; ++i) {
+        table.Set(std::make_shared<Symbol>("k" + std::to_string(i)), std::make_shared<Number>(i));
+    }
+    ASSERT_EQ(table.Size(), 1000u);
+    for (int i = 0; i < 1000; ++i) {
+        auto value = table.Find(std::make_shared<Symbol>("k" + std::to_string(i)));
+        ASSERT_TRUE(value);
+        EXPECT_EQ(As<Number>(*value)->GetValue(), i);
+    }
+    EXPECT_FALSE(table.Find(std::make_shared<Symbol>("k1000")));
+}
+
+TEST(HashTable, SetUpdatesFreshTablesAndCopiesShared) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(hash-count (hash-set! (hash-set! (make-hash-table) 'a 1) 'b 2))"),
+              "2");
+    std::stringstream in{"(hash-set! #hash((a . 1)) 'b 2)"};
+    Tokenizer tokenizer{&in};
+    auto expression = Read(&tokenizer);
+    auto literal = As<Cell>(As<Cell>(expression)->GetSecond())->GetFirst();
+    EXPECT_EQ(interpreter.Run(expression), "#hash((a . 1) (b . 2))");
+    EXPECT_EQ(interpreter.Run(expression), "#hash((a . 1) (b . 2))");
+    EXPECT_EQ(literal->ToString(), "#hash((a . 1))");
+}
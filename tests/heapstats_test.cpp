@@ -0,0 +1,85 @@
+#include "heapstats.h"
+#include "object.h"
+#include "parser.h"
+#include "tokenizer.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+bool Enabled() {
+    return DumpHeapStats().starts_with("{\"enabled\":true");
+}
+
+std::shared_ptr<Object> Parse(const std::string& text) {
+    std::stringstream in{text};
+    Tokenizer tokenizer{&in};
+    return Read(&tokenizer);
+}
+
+std::string Numbers(size_t count) {
+    std::string res = "(";
+    for (size_t i = 0; i < count; ++i) {
+        res += std::to_string(i) + " ";
+    }
+    res.back() = ')';
+    return res;
+}
+
+// The entries of the largest-objects section, from the first entry on.
+std::string Largest() {
+    auto dump = DumpHeapStats(1000);
+    return dump.substr(dump.find("\"largest\""));
+}
+
+}  // namespace
+
+TEST(HeapStats, LongListsAreListedAsOneStructure) {
+    if (!Enabled()) {
+        GTEST_SKIP() << "built without SCHEME_HEAP_STATS";
+    }
+    auto list = Parse(Numbers(1000));
+    std::string entry = "{\"type\":\"list\",\"bytes\":" + std::to_string(1000 * sizeof(Cell)) +
+                        ",\"preview\":\"(0 1 2 3";
+    EXPECT_NE(Largest().find(entry), std::string::npos);
+    list.reset();
+    EXPECT_EQ(Largest().find(entry), std::string::npos);
+
+    auto shorter = Parse(Numbers(10));
+    EXPECT_EQ(Largest().find("\"type\":\"list\""), std::string::npos);
+}
+
+TEST(HeapStats, PreviewsAreBounded) {
+    if (!Enabled()) {
+        GTEST_SKIP() << "built without SCHEME_HEAP_STATS";
+    }
+    std::vector<std::shared_ptr<Object>> items(1 << 20, std::make_shared<Number>(7));
+    items[0] = Parse("(1 (2 3) #(4))");
+    auto vector = std::make_shared<Vector>(std::move(items));
+    auto largest = Largest();
+    EXPECT_NE(largest.find("\"preview\":\"#((...) 7 7 7"), std::string::npos);
+    EXPECT_LT(largest.size(), 1024u);
+}
+
+TEST(HeapStats, DumpDoesNotReadObjectsOfOtherThreads) {
+    if (!Enabled()) {
+        GTEST_SKIP() << "built without SCHEME_HEAP_STATS";
+    }
+    std::shared_ptr<Vector> vector;
+    std::thread owner([&vector] {
+        vector = std::make_shared<Vector>(std::vector<std::shared_ptr<Object>>(
+            1000, std::make_shared<Number>(1)));
+    });
+    owner.join();
+    auto before = Largest();
+    // The owner's preview stands even after the vector changes under it.
+    vector->Set(0, std::make_shared<Number>(2));
+    EXPECT_EQ(Largest(), before);
+    EXPECT_NE(before.find("\"preview\":\"#(1 1 1"), std::string::npos);
+}
@@ -0,0 +1,120 @@
+#include "error.h"
+#include "image.h"
+#include "parser.h"
+#include "tokenizer.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::shared_ptr<Object> Parse(const std::string& text) {
+    std::stringstream in{text};
+    Tokenizer tokenizer{&in};
+    return Read(&tokenizer);
+}
+
+std::string Print(const std::vector<std::shared_ptr<Object>>& objects) {
+    std::string res;
+    for (auto& obj : objects) {
+        PrintDatum(obj.get(), &res);
+        res.push_back('\n');
+    }
+    return res;
+}
+
+// Offset of the first occurrence of a tag byte followed by a 32-bit count.
+size_t FindCount(const std::string& image, ImageTag tag, uint32_t count) {
+    std::string pattern(1, static_cast<char>(tag));
+    pattern.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    size_t pos = image.find(pattern);
+    EXPECT_NE(pos, std::string::npos);
+    return pos + 1;
+}
+
+void PatchCount(std::string* image, size_t offset, uint32_t count) {
+    std::memcpy(image->data() + offset, &count, sizeof(count));
+}
+
+template <class T>
+void Put(std::string* out, T value) {
+    out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// An image with no symbols holding one root: `depth` nested one-element vectors around '().
+std::string NestedVectorImage(size_t depth) {
+    std::string image(kImageMagic, sizeof(kImageMagic));
+    Put<uint32_t>(&image, kImageVersion);
+    Put<uint32_t>(&image, 0);
+    Put<uint32_t>(&image, 1);
+    for (size_t i = 0; i < depth; ++i) {
+        image.push_back(static_cast<char>(ImageTag::kVector));
+        Put<uint32_t>(&image, 1);
+    }
+    image.push_back(static_cast<char>(ImageTag::kNull));
+    return image;
+}
+
+std::shared_ptr<Object> NestedVector(size_t depth) {
+    std::shared_ptr<Object> res;
+    for (size_t i = 0; i < depth; ++i) {
+        res = std::make_shared<Vector>(std::vector<std::shared_ptr<Object>>{std::move(res)});
+    }
+    return res;
+}
+
+}  // namespace
+
+TEST(Image, RoundTrip) {
+    std::vector<std::shared_ptr<Object>> objects = {
+        Parse("(define (f x) (+ x 1))"), Parse("#(1 2.5 \"s\" #t)"), Parse("#hash((a . 1) (2 . b))"),
+        Parse("42")};
+    auto image = WriteImage(objects);
+    EXPECT_EQ(Print(ReadImage(image.data(), image.size())), Print(objects));
+}
+
+TEST(Image, RejectsTruncatedImage) {
+    auto image = WriteImage({Parse("(1 2 3)")});
+    for (size_t size = 0; size < image.size(); ++size) {
+        EXPECT_THROW(ReadImage(image.data(), size), SyntaxError) << size;
+    }
+}
+
+TEST(Image, RejectsOversizedCounts) {
+    auto image = WriteImage({Parse("(a b)"), Parse("#(1 2)"), Parse("#hash((1 . 2))")});
+    // The root count follows the two one-character symbol names.
+    size_t symbols = kImageSymbolCountOffset;
+    size_t roots = symbols + sizeof(uint32_t) + 2 * (sizeof(uint32_t) + 1);
+    std::vector<size_t> counts = {symbols, roots, FindCount(image, ImageTag::kList, 2),
+                                  FindCount(image, ImageTag::kVector, 2),
+                                  FindCount(image, ImageTag::kHashTable, 1)};
+    for (auto offset : counts) {
+        for (uint32_t count : {uint32_t{1} << 20, UINT32_MAX}) {
+            auto corrupt = image;
+            PatchCount(&corrupt, offset, count);
+            EXPECT_THROW(ReadImage(corrupt.data(), corrupt.size()), SyntaxError) << offset;
+        }
+    }
+}
+
+TEST(Image, MatchesHandBuiltLayout) {
+    auto image = WriteImage({NestedVector(3)});
+    EXPECT_EQ(image, NestedVectorImage(3));
+}
+
+TEST(Image, BoundsNestingDepth) {
+    auto image = NestedVectorImage(kMaxImageDepth);
+    EXPECT_EQ(ReadImage(image.data(), image.size()).size(), 1u);
+    image = NestedVectorImage(kMaxImageDepth + 1);
+    EXPECT_THROW(ReadImage(image.data(), image.size()), SyntaxError);
+    // Far deeper than the native stack could recurse through.
+    image = NestedVectorImage(size_t{1} << 20);
+    EXPECT_THROW(ReadImage(image.data(), image.size()), SyntaxError);
+
+    EXPECT_NO_THROW(WriteImage({NestedVector(kMaxImageDepth)}));
+    EXPECT_THROW(WriteImage({NestedVector(kMaxImageDepth + 1)}), RuntimeError);
+}
@@ -0,0 +1,97 @@
+#include "error.h"
+#include "scheme.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+
+namespace {
+
+std::string Nested(size_t depth) {
+    std::string res;
+    for (size_t i = 0; i < depth; ++i) {
+        res += "(+ 1 ";
+    }
+    res += "0";
+    res.append(depth, ')');
+    return res;
+}
+
+std::string Numbers(size_t count) {
+    std::string res = "'(";
+    for (size_t i = 0; i < count; ++i) {
+        res += std::to_string(i) + " ";
+    }
+    res.back() = ')';
+    return res;
+}
+
+}  // namespace
+
+TEST(Limits, MaxSteps) {
+    Interpreter interpreter;
+    interpreter.SetLimits({.max_steps = 100});
+    EXPECT_EQ(interpreter.Run(Nested(20)), "20");
+    EXPECT_THROW(interpreter.Run(Nested(200)), LimitError);
+    // The count starts over with every run.
+    EXPECT_EQ(interpreter.Run(Nested(20)), "20");
+}
+
+TEST(Limits, MaxStepsHoldInsideNativeLoops) {
+    Interpreter interpreter;
+    interpreter.SetLimits({.max_steps = 100});
+    EXPECT_EQ(interpreter.Run("(length (map abs " + Numbers(50) + "))"), "50");
+    EXPECT_THROW(interpreter.Run("(map abs " + Numbers(1000) + ")"), LimitError);
+    EXPECT_THROW(interpreter.Run("(filter number? " + Numbers(1000) + ")"), LimitError);
+    EXPECT_THROW(interpreter.Run("(fold-left + 0 " + Numbers(1000) + ")"), LimitError);
+    EXPECT_THROW(interpreter.Run("(vector-map abs (make-vector 1000 -1))"), LimitError);
+}
+
+TEST(Limits, MaxDepth) {
+    Interpreter interpreter;
+    interpreter.SetLimits({.max_depth = 10});
+    EXPECT_EQ(interpreter.Run(Nested(5)), "5");
+    EXPECT_THROW(interpreter.Run(Nested(50)), LimitError);
+    EXPECT_EQ(interpreter.Run(Nested(5)), "5");
+}
+
+TEST(Limits, Cancellation) {
+    CancellationToken cancel;
+    Interpreter interpreter;
+    interpreter.SetLimits({.cancel = &cancel});
+    EXPECT_EQ(interpreter.Run("(+ 1 2)"), "3");
+    cancel.Cancel();
+    EXPECT_THROW(interpreter.Run("(+ 1 2)"), LimitError);
+}
+
+TEST(Limits, CancellationStopsNativeLoops) {
+    CancellationToken cancel;
+    Interpreter interpreter;
+    interpreter.SetLimits({.cancel = &cancel});
+    size_t calls = 0;
+    interpreter.Register("cancel", [&cancel, &calls](int64_t x) {
+        ++calls;
+        cancel.Cancel();
+        return x;
+    });
+    EXPECT_THROW(interpreter.Run("(map cancel " + Numbers(10000) + ")"), LimitError);
+    EXPECT_LT(calls, 10000u);
+}
+
+TEST(Limits, NestedInterpreterRestoresTheOuterBudget) {
+    Interpreter inner;
+    Interpreter outer;
+    outer.SetLimits({.max_bytes = 1 << 16});
+    outer.Register("inner", [&inner]() -> int64_t { return inner.Run("(+ 1 2)") == "3"; });
+    EXPECT_EQ(outer.Run("(inner)"), "1");
+    EXPECT_THROW(outer.Run("(+ (inner) (vector-length (make-vector 1000000)))"), LimitError);
+}
+
+TEST(Limits, NestedInterpreterRestoresTheOuterStepHook) {
+    Interpreter inner;
+    Interpreter outer;
+    outer.SetLimits({.max_steps = 100});
+    outer.Register("inner", [&inner]() -> int64_t { return inner.Run("(+ 1 2)") == "3"; });
+    EXPECT_THROW(outer.Run("(+ (inner) (length (map abs " + Numbers(1000) + ")))"), LimitError);
+}
@@ -0,0 +1,76 @@
+#include "error.h"
+#include "scheme.h"
+
+#include <gtest/gtest.h>
+
+TEST(List, NestedQuotedLists) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(map car '((1 2) (3 4)))"), "(1 3)");
+    EXPECT_EQ(interpreter.Run("(map cdr '((1 2) (3 4)))"), "((2) (4))");
+    EXPECT_EQ(interpreter.Run("(map length '((1 2) (3) (4 5 6)))"), "(2 1 3)");
+    EXPECT_EQ(interpreter.Run("(length '((1 2) (3 4)))"), "2");
+    EXPECT_EQ(interpreter.Run("(reverse '((1 2) 3))"), "(3 (1 2))");
+    EXPECT_EQ(interpreter.Run("(append '((1)) '(2 (3 4)))"), "((1) 2 (3 4))");
+    EXPECT_EQ(interpreter.Run("(filter number? '(1 a (2) 3))"), "(1 3)");
+    EXPECT_EQ(interpreter.Run("(car '((1 2) (3 4)))"), "(1 2)");
+    EXPECT_EQ(interpreter.Run("(cdr '((1 2) (3 4)))"), "((3 4))");
+    EXPECT_EQ(interpreter.Run("(car (cdr '((1 2) (3 4))))"), "(3 4)");
+}
+
+TEST(List, NestedPrinting) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("'((((1))))"), "((((1))))");
+    EXPECT_EQ(interpreter.Run("'((1 . 2) (3 . 4))"), "((1 . 2) (3 . 4))");
+    EXPECT_EQ(interpreter.Run("'(a b . c)"), "(a b . c)");
+    EXPECT_EQ(interpreter.Run("'(1 () (2 (3)))"), "(1 () (2 (3)))");
+    EXPECT_EQ(interpreter.Run("'#((1 2) 3)"), "#((1 2) 3)");
+}
+
+TEST(List, ListsReturnedByBuiltins) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(map car (reverse '((1 2) (3 4))))"), "(3 1)");
+    EXPECT_EQ(interpreter.Run("(length (append '((1 2)) '((3 4))))"), "2");
+    EXPECT_EQ(interpreter.Run("(apply + (map car '((1 2) (3 4))))"), "4");
+}
+
+TEST(List, NestedResultsStayLists) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(car (car (cdr '((1 2) ((3 4) 5)))))"), "(3 4)");
+    EXPECT_EQ(interpreter.Run("(map cdr (cdr '((1 2) (3 4 5))))"), "((4 5))");
+    EXPECT_EQ(interpreter.Run("(list-ref '((1 2) (3 4)) 1)"), "(3 4)");
+    EXPECT_EQ(interpreter.Run("(list-tail '((1 2) (3 4)) 1)"), "((3 4))");
+    EXPECT_EQ(interpreter.Run("(list-tail '(1 2) 2)"), "()");
+    EXPECT_EQ(interpreter.Run("(fold-left + 0 (car '((1 2))))"), "3");
+    EXPECT_EQ(interpreter.Run("(apply append '((1) (2 3)))"), "(1 2 3)");
+    EXPECT_EQ(interpreter.Run("(length (reverse (cdr '((1) (2) (3)))))"), "2");
+}
+
+TEST(List, Predicates) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(pair? (car '((1 2) 3)))"), "#t");
+    EXPECT_EQ(interpreter.Run("(pair? '(a . b))"), "#t");
+    EXPECT_EQ(interpreter.Run("(list? (cdr '(1 2 3)))"), "#t");
+    EXPECT_EQ(interpreter.Run("(list? (cdr '(1 2 . 3)))"), "#f");
+    EXPECT_EQ(interpreter.Run("(null? (cdr '(1)))"), "#t");
+    EXPECT_EQ(interpreter.Run("(null? (list))"), "#t");
+    EXPECT_EQ(interpreter.Run("(null? (reverse '(1)))"), "#f");
+    EXPECT_THROW(interpreter.Run("(null? 1)"), RuntimeError);
+}
+
+TEST(List, FlatLists) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(length '())"), "0");
+    EXPECT_EQ(interpreter.Run("(map + '(1 2) '(10 20 30))"), "(11 22)");
+    EXPECT_EQ(interpreter.Run("(apply max 1 '(5 2))"), "5");
+    EXPECT_EQ(interpreter.Run("(fold-left - 0 '(1 2 3))"), "-6");
+    EXPECT_EQ(interpreter.Run("(fold-right - 0 '(1 2 3))"), "2");
+    EXPECT_EQ(interpreter.Run("(map abs '(-1 2))"), "(1 2)");
+}
+
+TEST(List, Errors) {
+    Interpreter interpreter;
+    EXPECT_THROW(interpreter.Run("(map car '(1 2))"), RuntimeError);
+    EXPECT_THROW(interpreter.Run("(length 1)"), RuntimeError);
+    EXPECT_THROW(interpreter.Run("(apply + '(9223372036854775807 1))"), RuntimeError);
+    EXPECT_THROW(interpreter.Run("(map abs (list (- -9223372036854775807 1)))"), RuntimeError);
+}
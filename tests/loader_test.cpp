@@ -0,0 +1,179 @@
+#include "error.h"
+#include "loader.h"
+#include "parser.h"
+#include "tokenizer.h"
+
+#include <gtest/gtest.h>
+
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+// Forms read one after another by a single tokenizer, printed one per line.
+std::string SerialRead(const std::string& text) {
+    std::stringstream in{text};
+    Tokenizer tokenizer{&in};
+    std::string res;
+    while (!tokenizer.IsEnd()) {
+        PrintDatum(Read(&tokenizer).get(), &res);
+        res.push_back('\n');
+    }
+    return res;
+}
+
+std::string Print(const std::vector<std::shared_ptr<Object>>& objects) {
+    std::string res;
+    for (auto& obj : objects) {
+        PrintDatum(obj.get(), &res);
+        res.push_back('\n');
+    }
+    return res;
+}
+
+// Top-level forms of every kind the loader has to keep whole, repeated to about size bytes.
+std::string Corpus(size_t size) {
+    const char* forms[] = {"(define (f x) (+ x 1))",   "\"a ( string ) with \\\" parens\"",
+                           "'(quoted list)",           "' (quote then space)",
+                           "`(1 ,(+ 1 2) ,@(list 4))", "#(1 2.5 \"s\" #t)",
+                           "(a (b (c (d))) . e)",      "42",
+                           "symbol",                   "#hash((a . 1))"};
+    std::string res;
+    for (size_t i = 0; res.size() < size; ++i) {
+        res += forms[i % std::size(forms)];
+        res += i % 7 ? " " : "\n\t";
+    }
+    return res;
+}
+
+// Pads text with forms and then spaces so that the next character lands at offset.
+void PadTo(std::string* text, size_t offset) {
+    while (text->size() + 8 < offset) {
+        text->append("(x 1) ");
+    }
+    text->append(offset - text->size(), ' ');
+}
+
+void ExpectWholeForms(const std::string& text, const std::vector<size_t>& bounds) {
+    ASSERT_GE(bounds.size(), 2u);
+    EXPECT_EQ(bounds.front(), 0u);
+    EXPECT_EQ(bounds.back(), text.size());
+    std::string chunks;
+    for (size_t i = 0; i + 1 < bounds.size(); ++i) {
+        ASSERT_LT(bounds[i], bounds[i + 1]);
+        chunks += SerialRead(text.substr(bounds[i], bounds[i + 1] - bounds[i]));
+    }
+    EXPECT_EQ(chunks, SerialRead(text));
+}
+
+}  // namespace
+
+TEST(Loader, SplitsAtTopLevelForms) {
+    auto text = Corpus(16 * kMinChunkSize);
+    auto bounds = SplitForms(text, 8);
+    EXPECT_GT(bounds.size(), 8u);
+    ExpectWholeForms(text, bounds);
+    for (size_t i = 1; i + 1 < bounds.size(); ++i) {
+        EXPECT_TRUE(std::isspace(static_cast<unsigned char>(text[bounds[i]]))) << bounds[i];
+    }
+}
+
+TEST(Loader, ShortInputsAreOneChunk) {
+    auto text = Corpus(kMinChunkSize / 2);
+    EXPECT_EQ(SplitForms(text, 64), (std::vector<size_t>{0, text.size()}));
+    EXPECT_EQ(SplitForms("", 4), (std::vector<size_t>{0, 0}));
+}
+
+TEST(Loader, DoesNotSplitInsideStrings) {
+    std::string text;
+    PadTo(&text, kMinChunkSize - 4);
+    size_t start = text.size();
+    text += "\"( a ) ) \\\" ( b \" (after string)";
+    size_t end = text.find(" (after");
+    text += " " + Corpus(kMinChunkSize);
+    auto bounds = SplitForms(text, 2);
+    for (auto bound : bounds) {
+        EXPECT_FALSE(bound > start && bound < end) << bound;
+    }
+    EXPECT_GT(bounds.size(), 2u);
+    ExpectWholeForms(text, bounds);
+}
+
+TEST(Loader, DoesNotSplitInsideLists) {
+    std::string text;
+    PadTo(&text, kMinChunkSize - 4);
+    text += "(a (b   c)   (d (e   f))   g)";
+    text += " " + Corpus(kMinChunkSize);
+    auto bounds = SplitForms(text, 2);
+    for (auto bound : bounds) {
+        EXPECT_FALSE(bound > kMinChunkSize - 4 && bound < kMinChunkSize + 25) << bound;
+    }
+    ExpectWholeForms(text, bounds);
+}
+
+TEST(Loader, DoesNotSplitAfterQuotePrefix) {
+    for (std::string prefix : {"'", "`", ",", ",@"}) {
+        std::string text;
+        PadTo(&text, kMinChunkSize - prefix.size());
+        text += prefix + "   (quoted form)";
+        text += " " + Corpus(kMinChunkSize);
+        auto bounds = SplitForms(text, 2);
+        for (auto bound : bounds) {
+            EXPECT_FALSE(bound >= kMinChunkSize && bound <= kMinChunkSize + 3) << prefix;
+        }
+        ExpectWholeForms(text, bounds);
+    }
+}
+
+TEST(Loader, ReadAllMatchesSerialRead) {
+    auto text = Corpus(8 * kMinChunkSize);
+    auto expected = SerialRead(text);
+    for (size_t threads : {1, 2, 3, 8, 32}) {
+        EXPECT_EQ(Print(ReadAll(text, threads)), expected) << threads;
+    }
+    EXPECT_EQ(Print(ReadAll(text)), expected);
+}
+
+TEST(Loader, ReadAllReportsErrorsFromAnyChunk) {
+    auto text = Corpus(4 * kMinChunkSize) + " (unterminated 1 2";
+    EXPECT_THROW(ReadAll(text, 4), SyntaxError);
+    text = "(1 . 2 3) " + Corpus(4 * kMinChunkSize);
+    EXPECT_THROW(ReadAll(text, 4), SyntaxError);
+}
+
+TEST(Loader, LoadFormsReadsFiles) {
+    char path[] = "/tmp/loader_testXXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    auto text = Corpus(4 * kMinChunkSize);
+    std::ofstream(path) << text;
+    EXPECT_EQ(Print(LoadForms(path, 4)), SerialRead(text));
+    std::ofstream(path, std::ios::trunc).flush();
+    EXPECT_TRUE(LoadForms(path, 4).empty());
+    std::remove(path);
+    EXPECT_THROW(LoadForms(path, 4), std::system_error);
+}
+
+TEST(Loader, HashConsingSharesSubtreesWithinChunks) {
+    auto text = Corpus(4 * kMinChunkSize);
+    HashConsStats stats;
+    auto forms = ReadAll(text, 4, &stats);
+    EXPECT_EQ(Print(forms), SerialRead(text));
+    EXPECT_GT(stats.nodes, 10 * stats.unique);
+    EXPECT_EQ(forms[0], forms[10]);
+    EXPECT_NE(forms[0], forms[1]);
+
+    HashConsStats serial;
+    ReadAll(text, 1, &serial);
+    EXPECT_EQ(serial.nodes, stats.nodes);
+    EXPECT_LE(serial.unique, stats.unique);
+}
@@ -0,0 +1,108 @@
+#include "error.h"
+#include "parser.h"
+#include "scheme.h"
+#include "tokenizer.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <sstream>
+#include <string>
+
+namespace {
+
+std::shared_ptr<Object> Parse(const std::string& text) {
+    std::stringstream in{text};
+    Tokenizer tokenizer{&in};
+    return Read(&tokenizer);
+}
+
+}  // namespace
+
+TEST(Macro, SyntaxRules) {
+    Interpreter interpreter;
+    interpreter.Run("(define-syntax add-all (syntax-rules () ((_ x ...) (+ x ... 0))))");
+    interpreter.Run("(define-syntax lst (syntax-rules () ((_ x ...) (quote (x ...)))))");
+    EXPECT_EQ(interpreter.Run("(add-all 1 2 3)"), "6");
+    EXPECT_EQ(interpreter.Run("(max 1 (add-all 4 5))"), "9");
+    EXPECT_EQ(interpreter.Run("(lst 1 2)"), "(1 2)");
+    EXPECT_THROW(interpreter.Run("(define-syntax bad 1)"), SyntaxError);
+}
+
+TEST(Macro, ExpansionCacheDoesNotOwnExpressions) {
+    Interpreter interpreter;
+    interpreter.Run("(define-syntax add-all (syntax-rules () ((_ x ...) (+ x ... 0))))");
+    std::weak_ptr<Object> weak;
+    {
+        auto expression = Parse("(add-all 1 2)");
+        EXPECT_EQ(interpreter.Run(expression), "3");
+        EXPECT_EQ(interpreter.Run(expression), "3");
+        weak = expression;
+    }
+    EXPECT_TRUE(weak.expired());
+}
+
+TEST(Macro, ExpansionCacheKeepsWorkingWhenFull) {
+    Interpreter interpreter;
+    interpreter.Run("(define-syntax add-all (syntax-rules () ((_ x ...) (+ x ... 0))))");
+    auto first = Parse("(add-all 1 2)");
+    EXPECT_EQ(interpreter.Run(first), "3");
+    for (int i = 0; i < 10000; ++i) {
+        auto expression = Parse("(add-all " + std::to_string(i) + " 1)");
+        ASSERT_EQ(interpreter.Run(expression), std::to_string(i + 1));
+        ASSERT_EQ(interpreter.Run("(add-all " + std::to_string(i) + " 2)"), std::to_string(i + 2));
+    }
+    EXPECT_EQ(interpreter.Run(first), "3");
+}
+
+TEST(Macro, Quasiquote) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("`(1 ,(+ 1 1) ,@(list 3 4))"), "(1 2 3 4)");
+    EXPECT_EQ(interpreter.Run("`#(1 ,(+ 1 1))"), "#(1 2)");
+    EXPECT_EQ(interpreter.Run("`#(1 ,@(list 2 3) 4)"), "#(1 2 3 4)");
+    EXPECT_EQ(interpreter.Run("`(a #(b ,(* 2 3)))"), "(a #(b 6))");
+    EXPECT_EQ(interpreter.Run("`#()"), "#()");
+    EXPECT_THROW(interpreter.Run("`#(1 ,@5)"), RuntimeError);
+}
+
+TEST(Macro, QuasiquoteNestedTemplates) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("`((1 2) ,(+ 1 2))"), "((1 2) 3)");
+    EXPECT_EQ(interpreter.Run("`(1 `(2 ,(3 ,(+ 1 3))))"),
+              "(1 (quasiquote (2 (unquote (3 4)))))");
+    EXPECT_EQ(interpreter.Run("`(1 ,@(map cdr '((1 2) (3 4))))"), "(1 (2) (4))");
+    EXPECT_EQ(interpreter.Run("`(1 ,@(list) 2)"), "(1 2)");
+    EXPECT_EQ(interpreter.Run("`(1 . ,(car '((2 3))))"), "(1 2 3)");
+    EXPECT_EQ(interpreter.Run("`(1 . ,(cdr (list 1)))"), "(1)");
+    EXPECT_EQ(interpreter.Run("(car (cdr `(0 ,(list 1 2))))"), "(1 2)");
+}
+
+TEST(Macro, LargeExpansionIsLinear) {
+    Interpreter interpreter;
+    interpreter.Run("(define-syntax sum (syntax-rules () ((_ x ...) (+ x ...))))");
+    std::string expression = "(sum";
+    for (int i = 0; i < 20000; ++i) {
+        expression += " 1";
+    }
+    expression += ")";
+    EXPECT_EQ(interpreter.Run(expression), "20000");
+}
+
+TEST(Macro, ExpansionIsChargedAgainstLimits) {
+    std::string expression = "(sum";
+    for (int i = 0; i < 4000; ++i) {
+        expression += " 1";
+    }
+    expression += ")";
+    Interpreter interpreter;
+    interpreter.Run("(define-syntax sum (syntax-rules () ((_ x ...) (+ x ...))))");
+    interpreter.SetLimits({.max_steps = 1000});
+    EXPECT_THROW(interpreter.Run(expression), LimitError);
+    EXPECT_THROW(interpreter.Run(Parse(expression)), LimitError);
+    EXPECT_EQ(interpreter.Run("(sum 1 2)"), "3");
+
+    CancellationToken cancel;
+    cancel.Cancel();
+    interpreter.SetLimits({.cancel = &cancel});
+    EXPECT_THROW(interpreter.Run(expression), LimitError);
+}
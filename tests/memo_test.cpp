@@ -0,0 +1,102 @@
+#include "error.h"
+#include "scheme.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool IsMemoized(const Interpreter& interpreter, const std::string& expression) {
+    auto memos = interpreter.Snapshot().memos;
+    return memos && memos->contains(expression);
+}
+
+}  // namespace
+
+TEST(Memo, MemoizesAfterThreshold) {
+    Interpreter interpreter;
+    std::string expression = "(+ 1 (* 2 3) (max 4 -5) (abs -6))";
+    for (int i = 1; i <= 40; ++i) {
+        ASSERT_EQ(interpreter.Run(expression), "17") << i;
+        EXPECT_EQ(IsMemoized(interpreter, expression), i >= 16) << i;
+    }
+}
+
+TEST(Memo, ComparisonResults) {
+    Interpreter interpreter;
+    interpreter.SetMemoThreshold(2);
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(interpreter.Run("(< 1 (+ 1 1) 3)"), "#t");
+        EXPECT_EQ(interpreter.Run("(= 2 (- 5 2))"), "#f");
+    }
+    EXPECT_TRUE(IsMemoized(interpreter, "(< 1 (+ 1 1) 3)"));
+}
+
+TEST(Memo, FailingExpressionStaysInterpreted) {
+    Interpreter interpreter;
+    std::string expression = "(- (/ 10 0) 1)";
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_THROW(interpreter.Run(expression), RuntimeError);
+    }
+    EXPECT_FALSE(IsMemoized(interpreter, expression));
+}
+
+TEST(Memo, RegisterDropsMemoizedResults) {
+    Interpreter interpreter;
+    interpreter.SetMemoThreshold(1);
+    std::string expression = "(max 1 2)";
+    EXPECT_EQ(interpreter.Run(expression), "2");
+    EXPECT_TRUE(IsMemoized(interpreter, expression));
+    interpreter.Register("max", [](int64_t a, int64_t b) { return a * 10 + b; });
+    EXPECT_FALSE(IsMemoized(interpreter, expression));
+    EXPECT_EQ(interpreter.Run(expression), "12");
+}
+
+TEST(Memo, DisabledUnderLimits) {
+    Interpreter interpreter;
+    interpreter.SetMemoThreshold(1);
+    EvalLimits limits;
+    limits.max_steps = 1000;
+    interpreter.SetLimits(limits);
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(interpreter.Run("(+ 1 2)"), "3");
+    }
+    EXPECT_FALSE(IsMemoized(interpreter, "(+ 1 2)"));
+}
+
+TEST(Memo, MatchesInterpretedResults) {
+    std::vector<std::string> expressions = {"(/ 7 2)", "(- 5)", "(+ 1 2.5)", "(max 1 (/ 1.0 4))",
+                                            "(< 1 2.5 3)", "(= 9007199254740993 9007199254740992.0)",
+                                            "(abs (- 3 10))"};
+    Interpreter plain;
+    plain.SetMemoThreshold(0);
+    Interpreter memoizing;
+    memoizing.SetMemoThreshold(1);
+    for (auto& expression : expressions) {
+        auto expected = plain.Run(expression);
+        for (int i = 0; i < 3; ++i) {
+            EXPECT_EQ(memoizing.Run(expression), expected) << expression;
+        }
+        EXPECT_TRUE(IsMemoized(memoizing, expression)) << expression;
+    }
+}
+
+TEST(Memo, OnlyConstantArithmetic) {
+    Interpreter interpreter;
+    interpreter.SetMemoThreshold(1);
+    for (std::string expression : {"(+ 1 (car '(1 2)))", "(list 1 2)", "(+ 1 . 2)"}) {
+        try {
+            interpreter.Run(expression);
+        } catch (const std::exception&) {
+        }
+        EXPECT_FALSE(IsMemoized(interpreter, expression)) << expression;
+    }
+    std::string expression = "(/ -9223372036854775808 -1)";
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_THROW(interpreter.Run(expression), RuntimeError);
+    }
+    EXPECT_FALSE(IsMemoized(interpreter, expression));
+}
@@ -0,0 +1,32 @@
+#include "error.h"
+#include "heapstats.h"
+#include "scheme.h"
+
+#include <gtest/gtest.h>
+
+TEST(Interpreter, Arithmetic) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(+ 1 2 3)"), "6");
+    EXPECT_EQ(interpreter.Run("(- 10 (* 2 3))"), "4");
+    EXPECT_EQ(interpreter.Run("(/ 7 2)"), "3");
+    EXPECT_EQ(interpreter.Run("(< 1 2 3)"), "#t");
+}
+
+TEST(Interpreter, Errors) {
+    Interpreter interpreter;
+    EXPECT_THROW(interpreter.Run("(+ 1"), SyntaxError);
+    EXPECT_THROW(interpreter.Run("(/ 1 0)"), RuntimeError);
+    EXPECT_THROW(interpreter.Run("(undefined 1)"), NameError);
+}
+
+TEST(Interpreter, LastRunAllocations) {
+    Interpreter interpreter;
+    interpreter.Run("(make-vector 64 (+ 1 2))");
+    auto totals = interpreter.GetLastRunAllocations();
+#ifdef SCHEME_HEAP_STATS
+    EXPECT_GT(totals.objects, 0u);
+    EXPECT_GT(totals.bytes, 0u);
+#else
+    EXPECT_EQ(totals.objects, 0u);
+#endif
+}
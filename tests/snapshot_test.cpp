@@ -0,0 +1,80 @@
+#include "error.h"
+#include "scheme.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+
+TEST(Snapshot, ChildrenShareStateUntilTheyChangeIt) {
+    Interpreter parent;
+    parent.Register("twice", [](int64_t x) { return 2 * x; });
+    auto snapshot = parent.Snapshot();
+    Interpreter first(snapshot);
+    Interpreter second(snapshot);
+    EXPECT_EQ(first.Snapshot().funcs, snapshot.funcs);
+    EXPECT_EQ(first.Run("(twice 4)"), "8");
+
+    first.Register("twice", [](int64_t x) { return 3 * x; });
+    first.Register("inc", [](int64_t x) { return x + 1; });
+    EXPECT_NE(first.Snapshot().funcs, snapshot.funcs);
+    EXPECT_EQ(first.Run("(inc (twice 4))"), "13");
+    EXPECT_EQ(second.Snapshot().funcs, snapshot.funcs);
+    EXPECT_EQ(second.Run("(twice 4)"), "8");
+    EXPECT_THROW(second.Run("(inc 1)"), NameError);
+    EXPECT_EQ(parent.Run("(twice 4)"), "8");
+}
+
+TEST(Snapshot, ChildrenInheritMacros) {
+    Interpreter parent;
+    parent.Run("(define-syntax add-all (syntax-rules () ((_ x ...) (+ x ... 0))))");
+    auto snapshot = parent.Snapshot();
+    Interpreter first(snapshot);
+    Interpreter second(snapshot);
+    EXPECT_EQ(first.Run("(add-all 1 2 3)"), "6");
+
+    first.Run("(define-syntax one (syntax-rules () ((_) 1)))");
+    EXPECT_EQ(first.Run("(add-all (one) 2)"), "3");
+    EXPECT_EQ(second.Snapshot().macros, snapshot.macros);
+    EXPECT_THROW(second.Run("(one)"), NameError);
+    EXPECT_EQ(second.Run("(add-all 4 5)"), "9");
+}
+
+TEST(Snapshot, ChildrenInheritMemoizedResults) {
+    Interpreter parent;
+    parent.SetMemoThreshold(2);
+    std::string expression = "(* (+ 1 2) (max 3 4))";
+    for (int i = 0; i < 2; ++i) {
+        EXPECT_EQ(parent.Run(expression), "12");
+    }
+    auto snapshot = parent.Snapshot();
+    ASSERT_TRUE(snapshot.memos && snapshot.memos->contains(expression));
+    Interpreter child(snapshot);
+    EXPECT_EQ(child.Run(expression), "12");
+    EXPECT_EQ(child.GetLastRunAllocations().objects, 0u);
+
+    // Redefining a builtin drops the inherited results along with the child's own.
+    child.Register("max", [](int64_t a, int64_t b) { return a + b; });
+    EXPECT_EQ(child.Run(expression), "21");
+    EXPECT_EQ(Interpreter(snapshot).Run(expression), "12");
+}
+
+TEST(Snapshot, CancellationTokenIsNotInherited) {
+    CancellationToken cancel;
+    Interpreter parent;
+    parent.SetLimits({.max_steps = 100, .cancel = &cancel});
+    auto snapshot = parent.Snapshot();
+    EXPECT_EQ(snapshot.limits.cancel, nullptr);
+    EXPECT_EQ(snapshot.limits.max_steps, 100u);
+
+    cancel.Cancel();
+    EXPECT_THROW(parent.Run("(+ 1 2)"), LimitError);
+    Interpreter child(snapshot);
+    EXPECT_EQ(child.Run("(+ 1 2)"), "3");
+    std::string deep;
+    for (int i = 0; i < 200; ++i) {
+        deep += "(+ 1 ";
+    }
+    deep += "0" + std::string(200, ')');
+    EXPECT_THROW(child.Run(deep), LimitError);
+}
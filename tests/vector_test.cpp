@@ -0,0 +1,59 @@
+#include "error.h"
+#include "parser.h"
+#include "scheme.h"
+#include "tokenizer.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+
+TEST(Vector, Builtins) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(make-vector 3 7)"), "#(7 7 7)");
+    EXPECT_EQ(interpreter.Run("(make-vector 2)"), "#(0 0)");
+    EXPECT_EQ(interpreter.Run("(vector-ref #(1 2 3) 1)"), "2");
+    EXPECT_EQ(interpreter.Run("(vector-set! #(1 2 3) 0 9)"), "#(9 2 3)");
+    EXPECT_EQ(interpreter.Run("(vector-length (make-vector 5))"), "5");
+    EXPECT_THROW(interpreter.Run("(vector-ref #(1 2 3) 3)"), RuntimeError);
+}
+
+TEST(Vector, MakeVectorRejectsHugeSizes) {
+    Interpreter interpreter;
+    EXPECT_THROW(interpreter.Run("(make-vector -1)"), RuntimeError);
+    EXPECT_THROW(interpreter.Run("(make-vector 100000000000)"), RuntimeError);
+    EXPECT_THROW(interpreter.Run("(make-vector 9223372036854775807)"), RuntimeError);
+    EXPECT_THROW(interpreter.Run("(make-vector " + std::to_string(kMaxVectorSize + 1) + ")"),
+                 RuntimeError);
+    EXPECT_EQ(interpreter.Run("(vector-length (make-vector 1000))"), "1000");
+}
+
+TEST(Vector, MakeVectorIsChargedAgainstTheByteLimit) {
+    Interpreter interpreter;
+    EvalLimits limits;
+    limits.max_bytes = 1 << 16;
+    interpreter.SetLimits(limits);
+    EXPECT_THROW(interpreter.Run("(make-vector 1000000)"), LimitError);
+    EXPECT_EQ(interpreter.Run("(vector-length (make-vector 100))"), "100");
+}
+
+TEST(Vector, ResultsStayVectors) {
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run("(vector-ref (vector-set! (make-vector 3) 1 5) 1)"), "5");
+    EXPECT_EQ(interpreter.Run("(vector-ref (make-vector 2 (list 1 2)) 0)"), "(1 2)");
+    EXPECT_EQ(interpreter.Run("(car (vector-ref (make-vector 2 (list 1 2)) 1))"), "1");
+    EXPECT_EQ(interpreter.Run("(vector-ref (vector-map abs (make-vector 2 -3)) 1)"), "3");
+    EXPECT_EQ(interpreter.Run("(vector-length (vector-set! (make-vector 100000) 5 1))"), "100000");
+    EXPECT_EQ(interpreter.Run("(vector-set! (vector-set! (make-vector 3) 0 1) 2 3)"), "#(1 0 3)");
+}
+
+TEST(Vector, SetLeavesSharedVectorsAlone) {
+    std::stringstream in{"(vector-set! #(1 2 3) 0 9)"};
+    Tokenizer tokenizer{&in};
+    auto expression = Read(&tokenizer);
+    auto literal = As<Cell>(As<Cell>(expression)->GetSecond())->GetFirst();
+    Interpreter interpreter;
+    EXPECT_EQ(interpreter.Run(expression), "#(9 2 3)");
+    EXPECT_EQ(interpreter.Run(expression), "#(9 2 3)");
+    EXPECT_EQ(literal->ToString(), "#(1 2 3)");
+}
@@ -1,11 +1,23 @@
 #include "tokenizer.h"
 #include "error.h"
+#include "object.h"
+
+#include <charconv>
 
 Tokenizer::Tokenizer(std::istream *in) {
     in_ = in;
     Next();
 }
 
+static bool IsSymbolStart(char c) {
+    return std::isalpha(c) || c == '<' || c == '=' || c == '>' || c == '*' || c == '/' || c == '#' ||
+           c == '_';
+}
+
+static bool IsSymbolChar(char c) {
+    return IsSymbolStart(c) || std::isdigit(c) || c == '?' || c == '!' || c == '-';
+}
+
 bool Tokenizer::IsEnd() {
     return end_;
 }
@@ -15,7 +27,6 @@ void Tokenizer::Next() {
     while (std::isspace(first)) {
         first = in_->get();
     }
-    std::set<char> allowed = {'<', '=', '>', '*', '/', '#'};
     if (first == EOF) {
         end_ = true;
     } else if (first == '(') {
@@ -24,37 +35,119 @@ void Tokenizer::Next() {
         tokens_ = BracketToken{BracketToken::CLOSE};
     } else if (first == '\'') {
         tokens_ = QuoteToken();
-    } else if (first == '.') {
-        tokens_ = DotToken();
-    } else if (std::isdigit(first) || first == '+' || first == '-') {
+    } else if (first == '`') {
+        tokens_ = QuasiquoteToken();
+    } else if (first == ',') {
+        bool splicing = in_->peek() == '@';
+        if (splicing) {
+            in_->get();
+        }
+        tokens_ = UnquoteToken{splicing};
+    } else if (first == '.' && !std::isdigit(in_->peek())) {
+        // "..." is the ellipsis symbol of syntax-rules patterns.
+        if (in_->peek() == '.') {
+            in_->get();
+            if (in_->get() != '.') {
+                throw SyntaxError();
+            }
+            tokens_ = SymbolToken("...");
+        } else {
+            tokens_ = DotToken();
+        }
+    } else if (first == '"') {
         std::string tmp;
-        tmp.push_back(first);
         first = in_->get();
-        while (std::isdigit(first)) {
+        while (first != '"') {
+            if (first == '\\') {
+                first = in_->get();
+            }
+            if (first == EOF) {
+                throw SyntaxError();
+            }
             tmp.push_back(first);
             first = in_->get();
         }
-        in_->unget();
+        tokens_ = StringToken(tmp);
+    } else if (first == '#' && in_->peek() == '(') {
+        in_->get();
+        tokens_ = VectorToken();
+    } else if (std::isdigit(first) || first == '+' || first == '-' || first == '.') {
+        std::string tmp;
+        tmp.push_back(first);
+        auto digits = [this, &tmp] {
+            while (std::isdigit(in_->peek())) {
+                tmp.push_back(in_->get());
+            }
+        };
+        bool real = first == '.';
+        bool symbol = false;
+        if (!std::isdigit(first) && (in_->peek() == 'i' || in_->peek() == 'n')) {
+            // +inf.0, -inf.0 and +nan.0.
+            while (IsSymbolChar(in_->peek()) || in_->peek() == '.') {
+                tmp.push_back(in_->get());
+            }
+            real = tmp.substr(1) == "inf.0" || tmp.substr(1) == "nan.0";
+            symbol = !real;
+        } else {
+            digits();
+            symbol = tmp.size() == 1 && !std::isdigit(first) && first != '.';
+            if (symbol && in_->peek() == '.') {
+                // +.5 and -.5: a sign directly followed by a fraction.
+                in_->get();
+                symbol = !std::isdigit(in_->peek());
+                in_->unget();
+            }
+            if (!symbol) {
+                if (in_->peek() == '.') {
+                    real = true;
+                    tmp.push_back(in_->get());
+                    digits();
+                }
+                if (in_->peek() == 'e' || in_->peek() == 'E') {
+                    real = true;
+                    tmp.push_back(in_->get());
+                    if (in_->peek() == '+' || in_->peek() == '-') {
+                        tmp.push_back(in_->get());
+                    }
+                    if (!std::isdigit(in_->peek())) {
+                        throw SyntaxError();
+                    }
+                    digits();
+                }
+            }
+        }
 
-        if (tmp == "+" || tmp == "-") {
+        if (real) {
+            double value;
+            if (!ParseFlonum(tmp, &value)) {
+                throw SyntaxError();
+            }
+            tokens_ = FloatToken{value};
+        } else if (symbol) {
             tokens_ = SymbolToken(tmp);
         } else {
-            tokens_ = ConstantToken(std::stoi(tmp));
+            int64_t value;
+            auto begin = tmp.data() + (tmp[0] == '+');
+            auto res = std::from_chars(begin, tmp.data() + tmp.size(), value);
+            if (res.ec != std::errc{}) {
+                throw SyntaxError();
+            }
+            tokens_ = ConstantToken(value);
         }
-    } else if (std::isalpha(first) || allowed.find(first) != allowed.end()) {
+    } else if (IsSymbolStart(first)) {
         std::string tmp;
         tmp.push_back(first);
-        allowed.insert('?');
-        allowed.insert('!');
-        allowed.insert('-');
         first = in_->get();
-        while (std::isalpha(first) || std::isdigit(first) || allowed.find(first) != allowed.end()) {
+        while (IsSymbolChar(first)) {
             tmp.push_back(first);
             first = in_->get();
         }
         in_->unget();
         if (tmp == "#t" || tmp == "#f") {
             tokens_ = BoolToken(tmp);
+        } else if (tmp == "#hash" && in_->peek() == '(') {
+            in_->get();
+            tokens_ = HashTableToken();
         } else {
             tokens_ = SymbolToken(tmp);
         }
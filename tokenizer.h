@@ -1,7 +1,8 @@
 #pragma once
 
-#include "../error.h"
+#include "error.h"
 
+#include <cstdint>
 #include <variant>
 #include <optional>
 #include <istream>
@@ -26,18 +27,44 @@ struct QuoteToken {
     }
 };
 
+struct QuasiquoteToken {
+    bool operator==(const QuasiquoteToken&) const {
+        return true;
+    }
+};
+
+struct UnquoteToken {
+    bool splicing = false;
+
+    bool operator==(const UnquoteToken& other) const {
+        return splicing == other.splicing;
+    }
+};
+
 struct DotToken {
     bool operator==(const DotToken&) const {
         return true;
     }
 };
 
+struct VectorToken {
+    bool operator==(const VectorToken&) const {
+        return true;
+    }
+};
+
+struct HashTableToken {
+    bool operator==(const HashTableToken&) const {
+        return true;
+    }
+};
+
 enum class BracketToken { OPEN, CLOSE };
 
 struct ConstantToken {
-    int value;
+    int64_t value;
 
-    ConstantToken(int val) : value(val) {
+    ConstantToken(int64_t val) : value(val) {
     }
 
     bool operator==(const ConstantToken& other) const {
@@ -45,6 +72,25 @@ struct ConstantToken {
     }
 };
 
+struct FloatToken {
+    double value;
+
+    bool operator==(const FloatToken& other) const {
+        return value == other.value;
+    }
+};
+
+struct StringToken {
+    std::string value;
+
+    StringToken(const std::string& s) : value(s) {
+    }
+
+    bool operator==(const StringToken& other) const {
+        return value == other.value;
+    }
+};
+
 struct BoolToken {
     bool bool_;
 
@@ -57,8 +103,9 @@ struct BoolToken {
     }
 };
 
-using Token =
-    std::variant<ConstantToken, BracketToken, SymbolToken, QuoteToken, DotToken, BoolToken>;
+using Token = std::variant<ConstantToken, FloatToken, BracketToken, SymbolToken, QuoteToken,
+                           DotToken, BoolToken, StringToken, VectorToken, HashTableToken,
+                           QuasiquoteToken, UnquoteToken>;
 
 class Tokenizer {
 public: